@@ -2,12 +2,20 @@
 #ifndef QIMAGEWIDGET_H
 #define QIMAGEWIDGET_H
 
+#include <mutex>
+
 #include <opencv2/core.hpp>
 
 #include <QtWidgets/QLabel>
 #include <QtCore/QFlags>
 #include <helpers/common.h>
 
+/**
+* Live preview: imshow() may be called from any thread and scales the frame down to the widget's size there. Only the
+* latest scaled frame is kept, older ones that the GUI thread has not picked up yet are dropped, so a busy GUI never
+* holds up the caller. The GUI thread paints the scaled frame without copying it. Mouse selections are reported in
+* frame coordinates.
+*/
 class QImageWidget : public QLabel {
     Q_OBJECT
 
@@ -17,19 +25,42 @@ public:
     void mousePressEvent(QMouseEvent* ev);
     void mouseReleaseEvent(QMouseEvent* ev);
     void mouseMoveEvent(QMouseEvent *ev);
+    void resizeEvent(QResizeEvent* ev);
+    void paintEvent(QPaintEvent* ev);
+    QSize sizeHint() const;
 
-    void imshow(const cv::Mat image);
+    //Shows an 8 bit BGR frame; the selection is drawn onto the preview only in the given RGB colour, so image itself
+    //is left untouched
+    void imshow(const cv::Mat& image, const cv::Rect& selection_rect = cv::Rect(),
+                const cv::Scalar& selection_color = cv::Scalar());
     void show_text(std::string text);
 
 private:
+    //An RGB frame at preview resolution together with the size of the frame it was scaled from
+    struct preview_frame {
+        cv::Mat image;
+        cv::Size frame_size;
+    };
+
+    cv::Point2i to_frame_coordinates(const QPoint& position) const;
+    QRect get_image_rect() const;
+
     mouse_selection selection;
 
+    //Handed over from imshow() to the GUI thread; a new frame replaces a pending one
+    std::mutex preview_mutex;
+    preview_frame pending_frame;
+    cv::Size preview_size;
+
+    //Only used by the GUI thread
+    preview_frame displayed_frame;
+
 signals:
     void area_selected(const mouse_selection& selection);
-    void new_frame(QPixmap pixmap);
+    void new_frame();
 
 private slots:
-    void got_new_frame(QPixmap pixmap);
+    void got_new_frame();
 };
 
 #endif //QIMAGEWIDGET_H
@@ -0,0 +1,94 @@
+/* VideoMagnification - Magnify motions and detect heartbeats
+Copyright (C) 2016 Christian Diller
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/**
+* Recycles the data of released matrices for later matrices of the same byte size, so that a frame loop that creates
+* the same matrices every frame stops allocating after warm-up. Matrices draw from the pool if their allocator is set
+* to it before their data is created, see matrix(). Thread safe; matrices may be released on any thread.
+* As pooled matrices may outlive the owner, the owner calls release() instead of delete; the pool then destroys
+* itself once the last of its matrices is gone. Sizes that are no longer requested, e.g. those of an earlier ROI, are
+* freed by release_unused().
+*/
+class BufferPool : public cv::MatAllocator {
+public:
+    BufferPool();
+    BufferPool(const BufferPool&) = delete;
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags,
+                           cv::UMatUsageFlags usage_flags) const override;
+    bool allocate(cv::UMatData* data, int access_flags, cv::UMatUsageFlags usage_flags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+    //An empty matrix that takes its data from the pool once it is created
+    template<typename T> cv::Mat_<T> matrix() {
+        cv::Mat_<T> pooled;
+        pooled.allocator = this;
+        return pooled;
+    }
+
+    //The same for matrices whose type is only known when they are created
+    cv::Mat matrix() {
+        cv::Mat pooled;
+        pooled.allocator = this;
+        return pooled;
+    }
+
+    //Without recycling, every matrix is allocated from and freed to the heap, e.g. for comparisons
+    void set_recycling(const bool recycling) noexcept;
+
+    //Number of heap allocations, i.e. requests the pool could not serve from released matrices
+    size_t get_n_allocations() const noexcept;
+
+    //Frees the released blocks of the sizes not requested in the last idle_generations calls, once per frame
+    void release_unused();
+
+    //Frees the released blocks right away; the pool destroys itself now or as soon as its last matrix is released
+    void release();
+
+private:
+    ~BufferPool();
+
+    static void free_blocks(const std::vector<cv::UMatData*>& blocks);
+
+    //Released blocks of one byte size and the generation in which that size was last requested
+    struct size_class {
+        std::vector<cv::UMatData*> blocks;
+        unsigned last_requested;
+    };
+
+    //Calls of release_unused() without request before a size is freed; spans the frames in flight in a pipeline
+    static const unsigned idle_generations = 16;
+
+    mutable std::mutex mutex;
+    mutable std::unordered_map<size_t, size_class> released_blocks;
+    unsigned generation = 0; //Counts the calls of release_unused()
+    mutable size_t n_outstanding = 0;
+    mutable std::atomic<size_t> n_allocations;
+    std::atomic<bool> recycling;
+    bool released = false;
+};
+
+#endif //BUFFER_POOL_H
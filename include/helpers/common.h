@@ -30,6 +30,29 @@ struct v4l2_option {
     int minimum;
     int maximum;
     int current;
+    bool read_only;
+    std::vector<std::string> menu_entries; //Names of the entries minimum to maximum of a MENU, if known
+};
+
+//Memory layout of a frame as read from the video source: BGR is 8 bit BGR (CV_8UC3), YUYV is packed 4:2:2 (CV_8UC2,
+//each pixel holds its luma and alternately U or V) and NV12 is a luma plane followed by an interleaved UV plane of half
+//the resolution (CV_8UC1 with 3/2 times the rows). YUYV and NV12 are BT.601 with limited range, as cameras send them.
+enum class pixel_format_type {
+    BGR, YUYV, NV12
+};
+
+//Format requested from video devices; AUTO prefers the raw formats if they allow the requested size and frame rate
+enum class capture_format_type {
+    AUTO, MJPEG, YUYV, NV12
+};
+
+//How video devices choose among the capture modes they offer: the largest frame size delivered at target_fps, as long
+//as its pixels per second stay within max_pixel_rate, the processing budget. If no mode reaches target_fps within the
+//budget, the fastest one within the budget is taken.
+struct capture_request {
+    capture_format_type format = capture_format_type::AUTO;
+    int target_fps = 30;
+    double max_pixel_rate = 640. * 480. * 30.;
 };
 
 struct mouse_selection {
@@ -57,25 +80,55 @@ struct analysis_data {
     double heartbeat_number;
 };
 
+//RIESZ magnifies the local phase of the Laplacian layers (phase-based motion magnification); it always filters the
+//phase with the IIR lowpass pair given by cutoffLo and cutoffHi, independent of the temporal filter type
 enum class spatial_filter_type {
-    NONE, LAPLACIAN, GAUSSIAN
+    NONE, LAPLACIAN, GAUSSIAN, RIESZ
 };
 
 enum class temporal_filter_type {
     IDEAL, IIR
 };
 
+//FFTW re-transforms the whole buffer per frame; SLIDING_DFT only updates the passband bins
+enum class ideal_filter_engine_type {
+    FFTW, SLIDING_DFT
+};
+
+//Memory layout of the ideal filter's temporal buffers: PIXEL_MAJOR stores each timeseries contiguously (one strided
+//write per frame), TILED stores tiles of 16 timeseries frame by frame (one contiguous write per tile and frame)
+enum class temporal_buffer_layout_type {
+    PIXEL_MAJOR, TILED
+};
+
+//Storage precision of the ideal filter's input history; samples are widened to float inside the filter kernel only.
+//Per stored sample, HALF is off by at most 2^-11*|x| (0.0625 for 8 bit input) and INT16 by at most 1/256 within
+//[-256, 256). As the filter is linear, this bounds the output error by e*(1 + 2*|alpha-1|*n_passband_bins).
+//The offline filter stores its amplified output in the history, beyond the INT16 range, so it uses HALF instead.
+enum class temporal_buffer_precision_type {
+    FLOAT, HALF, INT16
+};
+
+//Backing store of the ideal filter's temporal buffers: MAPPED_FILE keeps them in memory-mapped files on local disk,
+//which bounds the resident set when whole videos are buffered
+enum class temporal_buffer_storage_type {
+    MEMORY, MAPPED_FILE
+};
+
 struct parameter_store {
     //Filter types
     spatial_filter_type spatial_filter;
     temporal_filter_type temporal_filter;
+    ideal_filter_engine_type ideal_filter_engine;
 
     //Color
     int color_convert_forward, color_convert_backward;
     std::vector<bool> active_channels;
+    std::vector<int> layer_channels; //Frame channel of each of the n_channels channels the layers hold
 
     //Spatial filter parameters
     cv::Rect roi_rect;
+    std::vector<cv::Rect> extra_roi_rects; //Further ROIs of the same stream, each with its own heartbeat analysis
     int n_buffered_frames;
     int n_layers;
 
@@ -86,6 +139,11 @@ struct parameter_store {
     float max_freq;
     float cutoffLo;
     float cutoffHi;
+    temporal_buffer_layout_type temporal_buffer_layout;
+    temporal_buffer_precision_type temporal_buffer_precision;
+    temporal_buffer_storage_type temporal_buffer_storage;
+    std::string temporal_buffer_directory;
+    bool offline_filter; //The whole video is filtered at once in place of the input history, see magnify_video_offline
 
     //Video output parameters
     bool write_to_file;
@@ -97,9 +155,58 @@ struct parameter_store {
     int fps;
     int n_channels;
     bool analyze_heartbeat;
+    float analysis_update_rate; //Heartbeat analysis results per second; 0 analyses every frame
+    bool pool_buffers;
     bool shutdown;
 };
 
+//Reset all parameters to their default values
+inline void reset_parameters(parameter_store& params) {
+    //Filter types
+    params.spatial_filter = spatial_filter_type::NONE;
+    params.temporal_filter = temporal_filter_type::IDEAL;
+    params.ideal_filter_engine = ideal_filter_engine_type::FFTW;
+
+    //Color
+    params.color_convert_forward = -1;
+    params.color_convert_backward = -1; //Output frames are BGR, as cv::VideoWriter expects
+    params.active_channels = std::vector<bool>{true, true, true};
+    params.layer_channels = std::vector<int>{0, 1, 2};
+
+    //Spatial filter parameters
+    params.roi_rect = cv::Rect(0,0,0,0);
+    params.extra_roi_rects.clear();
+    params.n_buffered_frames = 5; //Seconds, will be multiplied by fps
+    params.n_layers = 3;
+
+    //Temporal filter parameters
+    params.alpha = 50.f;
+    params.lambda_c = 100.f;
+    params.min_freq = 1.f;
+    params.max_freq = 2.f;
+    params.cutoffLo = .25f;
+    params.cutoffHi = .6f;
+    params.temporal_buffer_layout = temporal_buffer_layout_type::PIXEL_MAJOR;
+    params.temporal_buffer_precision = temporal_buffer_precision_type::FLOAT;
+    params.temporal_buffer_storage = temporal_buffer_storage_type::MEMORY;
+    params.temporal_buffer_directory = "";
+    params.offline_filter = false;
+
+    //Video output parameters
+    params.write_to_file = false;
+    params.convert_whole_video = false;
+    params.output_fourcc = cv::VideoWriter::fourcc('M','P','4','2');
+    params.video_output_filename = "";
+
+    //Misc
+    params.fps = 1;
+    params.n_channels = 3;
+    params.analyze_heartbeat = false;
+    params.analysis_update_rate = 4.f;
+    params.pool_buffers = true;
+    params.shutdown = false;
+}
+
 inline cv::Size fit_to_layer(const cv::Size& original, const int layer_id) noexcept {
     return cv::Size(original.width/static_cast<int>(pow(2L, static_cast<long>(layer_id))),
                     original.height/static_cast<int>(pow(2L, static_cast<long>(layer_id))));
@@ -115,4 +222,68 @@ inline cv::Rect align_rect(const cv::Rect& original_rect, const int n_layers) no
                     original_rect.height-overlapping_pixels_height);
 }
 
+//roi_rect followed by the extra ROIs
+inline std::vector<cv::Rect> get_roi_rects(const parameter_store& params) {
+    std::vector<cv::Rect> roi_rects{params.roi_rect};
+    roi_rects.insert(roi_rects.end(), params.extra_roi_rects.begin(), params.extra_roi_rects.end());
+    return roi_rects;
+}
+
+//The regions that are converted to the float working format and back: Overlapping ROIs are merged into their bounding
+//rect, so that their common pixels are only converted once. They contain all ROIs and all processing regions; the
+//pixels outside pass through unchanged. Without extra ROIs, this is just roi_rect.
+inline std::vector<cv::Rect> get_converted_regions(const parameter_store& params) {
+    std::vector<cv::Rect> regions;
+    for(const cv::Rect& roi_rect : get_roi_rects(params)) {
+        if(roi_rect.area() > 0)
+            regions.push_back(roi_rect);
+    }
+    for(bool merged = true; merged; ) {
+        merged = false;
+        for(size_t i = 0; i < regions.size() && !merged; ++i) {
+            for(size_t j = i + 1; j < regions.size() && !merged; ++j) {
+                if((regions[i] & regions[j]).area() > 0) {
+                    regions[i] |= regions[j];
+                    regions.erase(regions.begin() + j);
+                    merged = true;
+                }
+            }
+        }
+    }
+    if(regions.empty())
+        regions.push_back(params.roi_rect);
+    return regions;
+}
+
+//The regions that are decomposed and filtered: the converted regions, each aligned to the number of layers. Without
+//extra ROIs, this is just roi_rect.
+inline std::vector<cv::Rect> get_processing_regions(const parameter_store& params) {
+    std::vector<cv::Rect> regions = get_converted_regions(params);
+    if(regions.size() > 1) {
+        for(cv::Rect& region : regions)
+            region = align_rect(region, params.n_layers);
+    }
+    return regions;
+}
+
+//Parameters for filtering a single region, whose temporal state is kept in a DataContainer of its own. Its layers only
+//hold the active channels, so that the inactive ones bypass decomposition, temporal filtering and reconstruction and
+//keep their input values; n_channels and active_channels then refer to the layer channels. Without any active
+//channel, the layers keep all channels, which pass the filters unchanged.
+inline parameter_store get_region_params(const parameter_store& params, const cv::Rect& region) {
+    parameter_store region_params = params;
+    region_params.roi_rect = region;
+    std::vector<int> layer_channels;
+    for(int channel_id = 0; channel_id < params.n_channels; ++channel_id) {
+        if(params.active_channels[channel_id])
+            layer_channels.push_back(params.layer_channels[channel_id]);
+    }
+    if(!layer_channels.empty()) {
+        region_params.n_channels = static_cast<int>(layer_channels.size());
+        region_params.active_channels = std::vector<bool>(layer_channels.size(), true);
+        region_params.layer_channels = layer_channels;
+    }
+    return region_params;
+}
+
 #endif //COMMON_H
@@ -22,56 +22,140 @@ along with this program. If not, see <http://www.gnu.org/licenses/>. */
 #include <opencv2/core.hpp>
 
 #include <helpers/common.h>
+#include <helpers/buffer_pool.h>
+#include <helpers/mapped_allocator.h>
+
+//Per-layer state of phase-based (RIESZ) magnification: the previous frame's Riesz pyramid coefficients (real, x and y
+//part), the accumulated quaternionic phase (cosine and sine part) and the IIR lowpass states of that phase; all of them
+//have the layer's channels
+struct riesz_layer_state {
+    cv::Mat previous[3];
+    cv::Mat phase[2];
+    cv::Mat lowpassLo[2];
+    cv::Mat lowpassHi[2];
+};
 
 class DataContainer {
 public:
     DataContainer(parameter_store& _params) noexcept;
+    DataContainer(const DataContainer&) = delete;
+    ~DataContainer();
 
     //Whole frame input and output
     void push_frame(const cv::Mat_<cv::Vec3f>& frame, parameter_store& _params);
-    cv::Mat_<cv::Vec3f> pop_frame() noexcept;
+    cv::Mat_<cv::Vec3f> pop_frame();
+
+    //Finishes the current frame without touching the frame data, for callers that reconstruct frames themselves; the
+    //buffer pool frees the sizes that are no longer requested
+    void advance_frame();
 
-    //Only the frame data within the current ROI
-    const cv::Mat_<cv::Vec3f> get_frame_roi();
+    //Only the layer channels of the frame data within the current ROI, see get_region_params(); they are zeroed in the
+    //frame, to which insert_reconstructed_layer_roi adds them back
+    const cv::Mat get_frame_roi();
 
-    //Single layer input and output
-    void put_layer(const int layer_id, const cv::Mat_<cv::Vec3f>& layer);
-    void insert_reconstructed_layer_roi(const cv::Mat_<cv::Vec3f>& roi);
-    cv::Mat_<cv::Vec3f> get_layer(const int layer_id) noexcept;
+    //Single layer input and output; layers have params.n_channels float channels
+    void put_layer(const int layer_id, const cv::Mat& layer);
+    void insert_reconstructed_layer_roi(const cv::Mat& roi);
+    cv::Mat get_layer(const int layer_id) noexcept;
 
-    //Access to data buffers
+    //Access to data buffers; only available with FLOAT temporal buffer precision
     cv::Mat_<float> get_input_timeseries(const int layer_id, const int timeseries_id, const int channel_id);
     cv::Mat_<float> get_output_timeseries(const int layer_id, const int timeseries_id, const int channel_id);
-    cv::Mat_<float> get_fftwf_data(const int layer_id, const int timeseries_id, const int channel_id);
+
+    //Distance in floats between two consecutive samples of an input or output timeseries handed to the filter
+    int get_timeseries_stride() const noexcept;
+
+    //Batched access: Timeseries rows (timeseries_id*n_channels+channel_id) are filtered in batches of the given size that
+    //start at multiples of it; within a batch, the first samples of consecutive rows lie get_timeseries_dist() floats
+    //apart, so a batch is a single call of an FFTW many-plan starting at the batch's first input or output timeseries
+    int get_timeseries_batch_size() const noexcept;
+    int get_timeseries_dist() const noexcept;
+
+    //Precision independent access for the filter kernels: With HALF or INT16 precision, only the input history is kept
+    //(in compact form) and widened to float on access, the output is only kept for the current frame
+    bool has_compact_timeseries() const noexcept;
+    void widen_input_timeseries(const int layer_id, const int timeseries_id, const int channel_id, float* timeseries);
+    float get_current_input_sample(const int layer_id, const int timeseries_id, const int channel_id);
+    void put_current_output_sample(const int layer_id, const int timeseries_id, const int channel_id, const float sample);
+
+    //Keeps the previous frame's output sample for the current frame, e.g. while the filter has no FFT plan yet; on the
+    //first frame, there is none and the input sample is passed through
+    void repeat_output_sample(const int layer_id, const int timeseries_id, const int channel_id);
+
+    //Offline filtering of whole videos (params.offline_filter): Only the input history is allocated, the filtered
+    //timeseries replace it and are then read back layer by layer for any frame; get_buffered_layer returns an empty
+    //matrix for layers without temporal buffer
+    void replace_input_timeseries(const int layer_id, const int timeseries_id, const int channel_id,
+                                  const float* timeseries);
+    cv::Mat get_buffered_layer(const int layer_id, const int frame_id);
+
+    //Out-of-core access: With MAPPED_FILE storage, filters process the timeseries in blocks, prefetch the next block
+    //and write back the finished one; in memory, a layer is a single block and both calls do nothing
+    int get_timeseries_block_size(const int layer_id) const noexcept;
+    void prefetch_timeseries(const int layer_id, const int first_timeseries, const int n_timeseries);
+    void write_back_timeseries(const int layer_id, const int first_timeseries, const int n_timeseries);
+
+    //Access to sliding DFT data; the sample delta is the newest minus the overwritten sample of each timeseries
+    float get_sample_delta(const int layer_id, const int timeseries_id, const int channel_id);
+    cv::Mat_<double> get_sliding_dft_bins(const int layer_id, const int timeseries_id, const int channel_id);
+    bool update_sliding_dft_band(const cv::Range& band);
 
     //Access to iir data
-    cv::Mat_<cv::Vec3f> get_lowpassLo(const int layer_id);
-    cv::Mat_<cv::Vec3f> get_lowpassHi(const int layer_id);
+    cv::Mat get_lowpassLo(const int layer_id);
+    cv::Mat get_lowpassHi(const int layer_id);
 
-    //Analysis data
-    cv::Mat_<float> get_average_roi_pixels();
+    //Access to phase-based magnification data; the state is empty until the first frame has been filtered
+    riesz_layer_state& get_riesz_state(const int layer_id);
 
     const int get_n_used_frames();
 
+    //Recycles the per-frame matrices of the frame loop; those handed out by this container are already pooled
+    BufferPool& get_buffer_pool() noexcept;
+
 private:
     void init_buffers();
+    bool has_temporal_buffers() const noexcept;
+    void put_timeseries_sample(const int buffer_id, const cv::Mat& layer);
+    cv::Mat get_timeseries_sample(const int buffer_id, const int layer_id);
+    cv::Mat_<float> get_timeseries(cv::Mat_<float>& buffer, const int row);
+    int get_n_timeseries_rows(const int buffer_id) const noexcept;
+    size_t get_sample_offset(const int row, const int position) const noexcept;
+    template<typename T> cv::Mat_<T> allocate_temporal_buffer(const int rows, const int cols);
+    void advise_timeseries(const int layer_id, const int first_timeseries, const int n_timeseries, const bool prefetch);
+
+    //Bytes of history per block of timeseries with MAPPED_FILE storage
+    static const size_t mapped_block_bytes = 64 << 20;
+
+    //Number of timeseries per tile in the TILED layout; one tile row fills a 64 byte cache line
+    static const int tile_width = 16;
+
+    //Owned by this container, but destroyed only after the last pooled matrix has been released
+    BufferPool* buffer_pool;
 
     //Spatial data storage
     cv::Mat_<cv::Vec3f> previous_input_frame;
     cv::Mat_<cv::Vec3f> current_input_frame;
 
     //Temporal data storage for IIR filtering
-    std::vector<cv::Mat_<cv::Vec3f>> current_layers;
-    std::vector<cv::Mat_<cv::Vec3f>> lowpassLo;
-    std::vector<cv::Mat_<cv::Vec3f>> lowpassHi;
+    std::vector<cv::Mat> current_layers;
+    std::vector<cv::Mat> lowpassLo;
+    std::vector<cv::Mat> lowpassHi;
 
-    //Temporal data storage for ideal filtering
+    //Temporal data storage for phase-based magnification
+    std::vector<riesz_layer_state> riesz_states;
+
+    //Temporal data storage for ideal filtering; the allocator has to outlive the buffers it allocated
+    MappedFileAllocator mapped_allocator;
     std::vector<cv::Mat_<float>> original_temporal_buffer;
     std::vector<cv::Mat_<float>> processed_temporal_buffer;
-    std::vector<cv::Mat_<float>> fftwf_buffer;
 
-    cv::Mat_<float> average_roi_pixels;
-    cv::Mat_<float> average_fft_bins;
+    //Input history with HALF or INT16 precision, same layout as original_temporal_buffer
+    std::vector<cv::Mat_<short>> compact_temporal_buffer;
+
+    //Temporal data storage for sliding DFT ideal filtering; bins hold interleaved real and imaginary parts
+    std::vector<cv::Mat_<float>> sample_delta;
+    std::vector<cv::Mat_<double>> sliding_dft_bins;
+    cv::Range sliding_dft_band;
 
     //Used to determine the current position within the ring buffer
     int current_frame_id = 0;
@@ -0,0 +1,114 @@
+/* VideoMagnification - Magnify motions and detect heartbeats
+Copyright (C) 2016 Christian Diller
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef FFTW_PLANNER_H
+#define FFTW_PLANNER_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <fftw3.h>
+
+//A batch of howmany 1D real FFTs of n samples each: Samples of a timeseries lie stride floats apart, the first samples
+//of consecutive timeseries dist floats. The spectra are always contiguous, n/2+1 complex numbers per timeseries.
+struct fftw_plan_key {
+    bool forward;
+    int n;
+    int stride;
+    int howmany;
+    int dist;
+
+    bool operator==(const fftw_plan_key& other) const noexcept {
+        return std::tie(forward, n, stride, howmany, dist) ==
+               std::tie(other.forward, other.n, other.stride, other.howmany, other.dist);
+    }
+
+    bool operator<(const fftw_plan_key& other) const noexcept {
+        return std::tie(forward, n, stride, howmany, dist) <
+               std::tie(other.forward, other.n, other.stride, other.howmany, other.dist);
+    }
+};
+
+/**
+* Creates and owns all FFTW plans of the application, as FFTW's planner may only be used by one thread at a time.
+* Plans are unaligned and planned on scratch arrays, so callers execute them with the new-array functions on their own
+* data, from any number of threads. Planning with FFTW_MEASURE takes long, so it never happens on the caller's thread:
+* get() plans a new key right away with FFTW_ESTIMATE, then queues its measurement on a background thread, whose plan
+* replaces the estimate on a later call. Known sizes are measured instantly from wisdom, which persists in a cache file.
+* get() never waits for a measurement in progress either; a new key is then estimated on the background thread before
+* the next measurement, so callers should keep their keys stable. Plans not requested between two calls of
+* release_unused() are destroyed, e.g. those of an earlier configuration.
+*/
+class FFTWPlanner {
+public:
+    static FFTWPlanner& instance();
+
+    //Missing or unreadable files are ignored; wisdom is only saved if its directory exists
+    bool load_wisdom(const std::string& filename);
+    bool save_wisdom(const std::string& filename);
+
+    //$XDG_CACHE_HOME/videomagnification.fftwf_wisdom or the same in ~/.cache; empty if neither is set
+    static std::string default_wisdom_filename();
+
+    //The best plan available without blocking on measurements; nullptr for a new key while the planner is busy
+    //measuring another one
+    fftwf_plan get(const fftw_plan_key& key);
+
+    //A measured plan, planned on the caller's thread if necessary, for one-off transforms of large amounts of data
+    fftwf_plan get_measured(const fftw_plan_key& key);
+
+    //Destroys the plans that were not requested since the last call, once per frame; the others stay valid
+    void release_unused();
+
+private:
+    FFTWPlanner();
+    ~FFTWPlanner();
+    FFTWPlanner(const FFTWPlanner&) = delete;
+
+    struct cached_plan {
+        fftwf_plan plan;
+        unsigned last_used; //Generation of the last request
+    };
+
+    fftwf_plan create(const fftw_plan_key& key, const unsigned flags);
+    fftwf_plan insert(std::map<fftw_plan_key, cached_plan>& plans, const fftw_plan_key& key, fftwf_plan plan);
+    fftwf_plan use(cached_plan& plan) noexcept;
+    void retire_unused(std::map<fftw_plan_key, cached_plan>& plans);
+    void destroy_retired();
+    void queue_measurement(const fftw_plan_key& key);
+    void start_planning_thread();
+    void plan_pending();
+
+    std::mutex planner_mutex; //Held around every call into the FFTW planner, including wisdom import and export
+    std::mutex plans_mutex;   //Guards the maps, queues and the generation below
+    std::condition_variable pending_changed;
+    std::map<fftw_plan_key, cached_plan> estimated_plans;
+    std::map<fftw_plan_key, cached_plan> measured_plans;
+    std::deque<fftw_plan_key> pending;           //Measurements
+    std::deque<fftw_plan_key> pending_estimates; //Estimates requested while the planner was busy
+    std::vector<fftwf_plan> retired_plans;       //Destroyed as soon as planner_mutex is free
+    unsigned generation = 0;                     //Counts the calls of release_unused()
+    std::thread planning_thread;
+    bool shutdown = false;
+};
+
+#endif //FFTW_PLANNER_H
@@ -0,0 +1,48 @@
+/* VideoMagnification - Magnify motions and detect heartbeats
+Copyright (C) 2016 Christian Diller
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef MAPPED_ALLOCATOR_H
+#define MAPPED_ALLOCATOR_H
+
+#include <string>
+
+#include <opencv2/core.hpp>
+
+/**
+* Allocates matrix data in memory-mapped, already unlinked files on local disk, so buffers larger than the RAM only
+* keep the pages that are in use resident. Fresh mappings are zero-filled without touching the disk.
+* prefetch and write_back give explicit control over a byte range of such a matrix: prefetch asks the kernel to read
+* the range ahead, write_back starts writing it to disk and drops it from the resident set.
+*/
+class MappedFileAllocator : public cv::MatAllocator {
+public:
+    //Files are created in directory; an empty directory uses $XDG_CACHE_HOME or ~/.cache, see mapped_allocator.cpp.
+    //Directories on a tmpfs are reported on stderr, as they keep the buffers in RAM.
+    void set_directory(const std::string& directory);
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags,
+                           cv::UMatUsageFlags usage_flags) const override;
+    bool allocate(cv::UMatData* data, int access_flags, cv::UMatUsageFlags usage_flags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+    static void prefetch(const void* begin, const size_t n_bytes) noexcept;
+    static void write_back(void* begin, const size_t n_bytes) noexcept;
+
+private:
+    std::string directory;
+};
+
+#endif //MAPPED_ALLOCATOR_H
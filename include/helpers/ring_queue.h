@@ -0,0 +1,96 @@
+/* VideoMagnification - Magnify motions and detect heartbeats
+Copyright (C) 2016 Christian Diller
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+/**
+* Bounded lock-free single-producer/single-consumer ring queue
+* Exactly one thread may push and exactly one thread may pop; push and pop block (spinning, then sleeping) while the
+* queue is full or empty, respectively
+*/
+template<typename T>
+class RingQueue {
+public:
+    explicit RingQueue(const size_t depth) : slots(depth + 1), head(0), tail(0), max_occupancy(0) { }
+    RingQueue(const RingQueue&) = delete;
+
+    bool try_push(T& item) {
+        const size_t current_tail = tail.load(std::memory_order_relaxed);
+        const size_t next_tail = (current_tail + 1) % slots.size();
+        if(next_tail == head.load(std::memory_order_acquire))
+            return false; //Full
+        slots[current_tail] = std::move(item);
+        tail.store(next_tail, std::memory_order_release);
+
+        const size_t current_occupancy = occupancy();
+        if(current_occupancy > max_occupancy.load(std::memory_order_relaxed))
+            max_occupancy.store(current_occupancy, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool try_pop(T& item) {
+        const size_t current_head = head.load(std::memory_order_relaxed);
+        if(current_head == tail.load(std::memory_order_acquire))
+            return false; //Empty
+        item = std::move(slots[current_head]);
+        head.store((current_head + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    void push(T& item) {
+        for(int n_attempts = 0; !try_push(item); ++n_attempts)
+            backoff(n_attempts);
+    }
+
+    void pop(T& item) {
+        for(int n_attempts = 0; !try_pop(item); ++n_attempts)
+            backoff(n_attempts);
+    }
+
+    //Maximum number of queued items
+    size_t depth() const noexcept { return slots.size() - 1; }
+
+    //Number of currently queued items; only a snapshot if called while another thread pushes or pops
+    size_t occupancy() const noexcept {
+        const size_t current_head = head.load(std::memory_order_acquire);
+        const size_t current_tail = tail.load(std::memory_order_acquire);
+        return (current_tail + slots.size() - current_head) % slots.size();
+    }
+
+    //Highest occupancy observed so far
+    size_t get_max_occupancy() const noexcept { return max_occupancy.load(std::memory_order_relaxed); }
+
+private:
+    static void backoff(const int n_attempts) {
+        if(n_attempts < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+
+    std::vector<T> slots;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<size_t> max_occupancy;
+};
+
+#endif //RING_QUEUE_H
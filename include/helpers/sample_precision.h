@@ -0,0 +1,107 @@
+/* VideoMagnification - Magnify motions and detect heartbeats
+Copyright (C) 2016 Christian Diller
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef SAMPLE_PRECISION_H
+#define SAMPLE_PRECISION_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include <helpers/common.h>
+
+//INT16 samples are stored in steps of 1/128, covering [-256, 256) which holds all layers of 8 bit input frames
+const float int16_sample_scale = 128.f;
+
+inline int16_t float_to_half(const float value) noexcept {
+#ifdef __F16C__
+    return static_cast<int16_t>(_cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT));
+#else
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    if(exponent >= 31) //Overflow, infinity and NaN
+        return static_cast<int16_t>(sign | 0x7c00u | (((bits >> 23) & 0xffu) == 0xffu && mantissa ? 0x200u : 0u));
+    if(exponent <= 0) { //Subnormal half or zero
+        if(exponent < -10)
+            return static_cast<int16_t>(sign);
+        mantissa |= 0x800000u;
+        const uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half_mantissa = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1u), halfway = 1u << (shift - 1u);
+        if(remainder > halfway || (remainder == halfway && (half_mantissa & 1u)))
+            ++half_mantissa;
+        return static_cast<int16_t>(sign | half_mantissa);
+    }
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    const uint32_t remainder = mantissa & 0x1fffu;
+    if(remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+        ++half; //Round to nearest even; a carry into the exponent correctly rounds up to the next power of two
+    return static_cast<int16_t>(half);
+#endif
+}
+
+inline float half_to_float(const int16_t value) noexcept {
+#ifdef __F16C__
+    return _cvtsh_ss(static_cast<unsigned short>(value));
+#else
+    const uint32_t half = static_cast<uint16_t>(value);
+    const uint32_t sign = (half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+
+    uint32_t bits;
+    if(exponent == 0x1fu) //Infinity and NaN
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    else if(exponent != 0)
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    else if(mantissa == 0)
+        bits = sign;
+    else { //Subnormal half, normalise it
+        exponent = 127 - 15 + 1;
+        while(!(mantissa & 0x400u)) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+    }
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+#endif
+}
+
+inline int16_t encode_sample(const float value, const temporal_buffer_precision_type precision) noexcept {
+    if(precision == temporal_buffer_precision_type::HALF)
+        return float_to_half(value);
+    const float scaled = std::round(value * int16_sample_scale);
+    return static_cast<int16_t>(scaled < -32768.f ? -32768.f : (scaled > 32767.f ? 32767.f : scaled));
+}
+
+inline float decode_sample(const int16_t value, const temporal_buffer_precision_type precision) noexcept {
+    if(precision == temporal_buffer_precision_type::HALF)
+        return half_to_float(value);
+    return static_cast<float>(value) / int16_sample_scale;
+}
+
+#endif //SAMPLE_PRECISION_H
@@ -0,0 +1,103 @@
+/* VideoMagnification - Magnify motions and detect heartbeats
+Copyright (C) 2016 Christian Diller
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Work done by one worker thread since the pool was started or its statistics were reset
+struct worker_utilisation {
+    double busy_seconds;
+    double wall_seconds;
+    long long n_tasks;
+    long long n_steals;
+
+    double busy_fraction() const noexcept { return wall_seconds > 0. ? busy_seconds / wall_seconds : 0.; }
+};
+
+/**
+* Persistent pool of worker threads shared by all processing stages, so that no stage starts threads of its own.
+* parallel_for splits the task indices into one contiguous range per thread; each thread runs its own range front to
+* back and, once it is done, steals the back half of another thread's range. The calling thread takes part in its
+* own job, so stages may call parallel_for concurrently or from within a task. Thread safe.
+*/
+class TaskPool {
+public:
+    static TaskPool& instance();
+
+    //Worker threads plus the calling thread, i.e. the number of distinct thread ids a task may be called with
+    int get_n_threads() const noexcept;
+
+    //Calls task(task_id, thread_id) for every task_id in [0, n_tasks) and returns once all calls have returned;
+    //thread_id is below get_n_threads() and unique among the concurrently running calls of this job
+    void parallel_for(const int n_tasks, const std::function<void(int, int)>& task);
+
+    //One entry per worker thread; the calling threads' share of the work is not included
+    std::vector<worker_utilisation> get_utilisation() const;
+    void reset_utilisation();
+
+private:
+    //The task ids a thread has yet to run; other threads steal from its end
+    struct task_range {
+        std::mutex mutex;
+        int begin = 0;
+        int end = 0;
+    };
+
+    struct job {
+        const std::function<void(int, int)>* task;
+        std::unique_ptr<task_range[]> ranges;
+        std::atomic<int> n_unfinished;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    struct worker_state {
+        std::thread thread;
+        std::atomic<long long> busy_nanoseconds;
+        std::atomic<long long> n_tasks;
+        std::atomic<long long> n_steals;
+    };
+
+    TaskPool();
+    ~TaskPool();
+    TaskPool(const TaskPool&) = delete;
+
+    void work(const int worker_id);
+    void run(job& current_job, const int thread_id, worker_state* state);
+    bool take(job& current_job, const int thread_id, int& task_id, worker_state* state);
+    void retire(const std::shared_ptr<job>& current_job);
+
+    const int n_workers;
+    std::unique_ptr<worker_state[]> workers;
+    std::chrono::steady_clock::time_point statistics_start;
+
+    mutable std::mutex mutex; //Guards the statistics start, the jobs below and shutdown
+    std::condition_variable jobs_changed;
+    std::vector<std::shared_ptr<job>> jobs;
+    size_t next_job = 0;
+    bool shutdown = false;
+};
+
+#endif //TASK_POOL_H
@@ -1,10 +1,24 @@
 #ifndef V4L2_HPP
 #define V4L2_HPP
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 #include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
 
 #include <fcntl.h>
+#include <poll.h>
 #include <libv4l2.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -21,18 +35,27 @@ inline bool failed(std::string why) {
     return false;
 }
 
+/**
+* Captures MJPEG frames into a ring of n_buffers memory-mapped driver buffers. A capture thread dequeues each filled
+* buffer as soon as the driver hands it over; operator>> decodes the oldest one in place and only then gives it back to
+* the driver. Thus the driver can keep filling the other buffers while a frame is being decoded, and frames are only
+* dropped when the consumer falls behind by more than the whole ring. Each frame keeps the driver's timestamp.
+* The capture mode, i.e. format, frame size and frame interval, is chosen among the ones the device enumerates according
+* to a capture_request; with format AUTO, raw YUYV or NV12 frames are preferred over MJPEG for the same size and rate.
+* read() hands raw frames out undecoded, operator>> always returns BGR.
+*/
 class V4L2Capture {
 public:
     V4L2Capture() { }
+    V4L2Capture(const V4L2Capture&) = delete;
 
     ~V4L2Capture() {
         release();
     }
 
-    bool open(const std::string device, cv::Size_<unsigned int> _frame_size = {640, 480}) {
-        frame_size = _frame_size;
+    bool open(const std::string device, const int n_buffers = 4, const capture_request& request = capture_request()) {
         //Open the specified device
-        if((video_device_fd = v4l2_open(device.c_str(), O_RDWR)) < 0)
+        if((video_device_fd = v4l2_open(device.c_str(), O_RDWR | O_NONBLOCK)) < 0)
             return failed("Could not open video device " + device);
 
         //Query capabilities of that device
@@ -55,121 +78,176 @@ public:
            !(capabilities.capabilities & V4L2_CAP_STREAMING))
             return failed("Video device " + device + " does not support video streaming");
 
-        //Set the format
-        v4l2_format format = {0};
-        format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
-        format.fmt.pix.width = frame_size.width;
-        format.fmt.pix.height = frame_size.height;
-
-        if(v4l2_ioctl(video_device_fd, VIDIOC_S_FMT, &format) < 0)
+        //Set the format: Raw frames skip the JPEG decoding, but USB cameras often only send them at lower frame rates
+        std::vector<unsigned int> pixel_formats;
+        if(request.format == capture_format_type::AUTO)
+            pixel_formats = {V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_MJPEG};
+        else if(request.format == capture_format_type::YUYV)
+            pixel_formats = {V4L2_PIX_FMT_YUYV};
+        else if(request.format == capture_format_type::NV12)
+            pixel_formats = {V4L2_PIX_FMT_NV12};
+        else
+            pixel_formats = {V4L2_PIX_FMT_MJPEG};
+        enumerate_capture_modes(pixel_formats, request.target_fps);
+        bool format_set = false;
+        if(!capture_modes.empty()) {
+            current_capture_mode = choose_capture_mode(pixel_formats, request);
+            format_set = set_format(capture_modes[current_capture_mode], false);
+        } else {
+            //Drivers without frame size enumeration: Try each format at 640x480 and the target rate
+            const v4l2_fract target_interval = {1, static_cast<unsigned int>(std::max(request.target_fps, 1))};
+            for(size_t format_id = 0; format_id < pixel_formats.size() && !format_set; ++format_id)
+                format_set = set_format({pixel_formats[format_id], {640, 480}, target_interval},
+                                        request.format == capture_format_type::AUTO);
+        }
+        if(!format_set)
             return failed("Could not set the video format of video device " + device);
-
-        v4l2_streamparm streamparm = {0};
-        streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        if (v4l2_ioctl(video_device_fd, VIDIOC_G_PARM, &streamparm) < 0)
-            return failed("Could not query streamparm");
-
-        streamparm.parm.capture.capturemode |= V4L2_CAP_TIMEPERFRAME;
-        streamparm.parm.capture.timeperframe.numerator = 1;
-        streamparm.parm.capture.timeperframe.denominator = 33;
-        if(v4l2_ioctl(video_device_fd, VIDIOC_S_PARM, &streamparm) < 0)
-            return failed("Could not set streamparm");
+        std::cout << "Capturing " << fourcc_to_string(pixel_format) << " " << frame_size.width << "x" <<
+             frame_size.height << " at " << get_fps() << " fps" << std::endl;
 
         //Query all available options
         v4l2_queryctrl queryctrl = {0};
         queryctrl.id = V4L2_CTRL_CLASS_USER | V4L2_CTRL_FLAG_NEXT_CTRL;
         while (v4l2_ioctl(video_device_fd, VIDIOC_QUERYCTRL, &queryctrl) == 0) {
             if (V4L2_CTRL_ID2CLASS(queryctrl.id) != V4L2_CTRL_CLASS_USER) break;
-            if (queryctrl.flags & V4L2_CTRL_FLAG_DISABLED) continue;
+            const v4l2_queryctrl control = queryctrl;
+            queryctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
+            if (control.flags & V4L2_CTRL_FLAG_DISABLED) continue;
 
             v4l2_option current_option = {0};
-            current_option.id = queryctrl.id;
-            if(queryctrl.type == 1) current_option.type = v4l2_option_type::INTEGER;
-            else if(queryctrl.type == 2) current_option.type = v4l2_option_type::BOOLEAN;
-            else if(queryctrl.type == 3) current_option.type = v4l2_option_type::MENU;
+            current_option.id = control.id;
+            if(control.type == 1) current_option.type = v4l2_option_type::INTEGER;
+            else if(control.type == 2) current_option.type = v4l2_option_type::BOOLEAN;
+            else if(control.type == 3) current_option.type = v4l2_option_type::MENU;
             else continue;
-            current_option.name = std::string(queryctrl.name, queryctrl.name+sizeof(queryctrl.name));
+            current_option.name = std::string(control.name, control.name+sizeof(control.name));
             current_option.name = current_option.name.substr(0, current_option.name.find(static_cast<char>(0)));
-            current_option.minimum = queryctrl.minimum;
-            current_option.maximum = queryctrl.maximum;
-            current_option.current = queryctrl.default_value;
+            current_option.minimum = control.minimum;
+            current_option.maximum = control.maximum;
+            current_option.current = control.default_value;
+            current_option.read_only = (control.flags & V4L2_CTRL_FLAG_READ_ONLY) != 0;
             capture_options.push_back(current_option);
-
-            queryctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
         }
         if (errno != EINVAL)
             return failed("Querying controls failed");
 
-        //Request buffer requirements
+        //Request the buffer ring; the driver may hand out a different number of buffers
         v4l2_requestbuffers bufrequest = {0};
         bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         bufrequest.memory = V4L2_MEMORY_MMAP;
-        bufrequest.count = 1;
-
-        if(v4l2_ioctl(video_device_fd, VIDIOC_REQBUFS, &bufrequest) < 0)
-            return failed("Requesting buffer failed");
+        bufrequest.count = static_cast<unsigned int>(std::max(n_buffers, 2));
 
-        bufferinfo = {0};
-        bufferinfo.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        bufferinfo.memory = V4L2_MEMORY_MMAP;
-        bufferinfo.index = 0;
+        if(v4l2_ioctl(video_device_fd, VIDIOC_REQBUFS, &bufrequest) < 0 || bufrequest.count == 0)
+            return failed("Requesting buffers failed");
 
-        if(v4l2_ioctl(video_device_fd, VIDIOC_QUERYBUF, &bufferinfo) < 0)
-            return failed("Querying buffer failed");
+        for(unsigned int buffer_id = 0; buffer_id < bufrequest.count; ++buffer_id) {
+            v4l2_buffer bufferinfo = {0};
+            bufferinfo.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            bufferinfo.memory = V4L2_MEMORY_MMAP;
+            bufferinfo.index = buffer_id;
 
-        //Create the frame buffer
-        buffer = static_cast<unsigned char*>(mmap(NULL, bufferinfo.length,
-                PROT_READ | PROT_WRITE, MAP_SHARED,
-                video_device_fd, bufferinfo.m.offset
-        ));
+            if(v4l2_ioctl(video_device_fd, VIDIOC_QUERYBUF, &bufferinfo) < 0)
+                return failed("Querying buffer failed");
 
-        if(buffer == MAP_FAILED)
-            return failed("Memory mapping failed");
+            //Map the frame buffer
+            void* start = v4l2_mmap(NULL, bufferinfo.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                    video_device_fd, bufferinfo.m.offset);
+            if(start == MAP_FAILED)
+                return failed("Memory mapping failed");
+            buffers.push_back({static_cast<unsigned char*>(start), bufferinfo.length});
 
-        //Prepare for buffering
-        bufferinfo = {0};
-        bufferinfo.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        bufferinfo.memory = V4L2_MEMORY_MMAP;
-        bufferinfo.index = 0;
+            if(v4l2_ioctl(video_device_fd, VIDIOC_QBUF, &bufferinfo) < 0)
+                return failed("Queuing a new buffer failed");
+        }
 
-        if(v4l2_ioctl(video_device_fd, VIDIOC_STREAMON, &bufferinfo.type) < 0)
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if(v4l2_ioctl(video_device_fd, VIDIOC_STREAMON, &type) < 0)
             return failed("Activating the stream failed");
+        streaming = true;
 
-        if(v4l2_ioctl(video_device_fd, VIDIOC_QBUF, &bufferinfo) < 0)
-            return failed("Queuing a new buffer failed");
-
+        shutdown = false;
+        capture_thread = std::thread(&V4L2Capture::capture_loop, this);
         return true; //Everything went well
     }
 
+    //Decodes the oldest captured frame to BGR straight from its driver buffer, then requeues that buffer
     void operator>>(cv::Mat& out) {
-        if(v4l2_ioctl(video_device_fd, VIDIOC_DQBUF, &bufferinfo) < 0)
-            failed("Grabbing the current output frame failed");
+        read(out, false);
+    }
 
-        if(v4l2_ioctl(video_device_fd, VIDIOC_QBUF, &bufferinfo) < 0)
-            failed("Queuing a new buffer failed");
+    //Like operator>>, but raw frames are only copied out of the driver buffer, see get_pixel_format()
+    void read(cv::Mat& out) {
+        read(out, true);
+    }
 
-        //For uncompressed frames
-        /*cv::Mat output(frame_size.height, frame_size.width, CV_8UC2, buffer);
-        cv::cvtColor(output, out, CV_YUV2BGR_YVYU);*/
+    //Format of the frames returned by read(); MJPEG frames are always decoded to BGR
+    pixel_format_type get_pixel_format() const {
+        if(pixel_format == V4L2_PIX_FMT_YUYV)
+            return pixel_format_type::YUYV;
+        if(pixel_format == V4L2_PIX_FMT_NV12)
+            return pixel_format_type::NV12;
+        return pixel_format_type::BGR;
+    }
 
-        out = cv::imdecode(std::vector<uchar>(buffer, buffer+bufferinfo.length), CV_LOAD_IMAGE_COLOR);
-        if(out.empty())
-            out = cv::Mat(100,100,CV_8UC3);
+    //Capture time of the frame returned last; with a monotonic driver clock, this is when the driver captured it
+    std::chrono::steady_clock::time_point get_timestamp() const {
+        return last_timestamp;
     }
 
     void release() {
-        if(v4l2_ioctl(video_device_fd, VIDIOC_STREAMOFF, &bufferinfo.type) < 0)
-            failed("Deactivating the stream failed");
-
-        close(video_device_fd);
+        {
+            std::lock_guard<std::mutex> lock(capture_mutex);
+            shutdown = true;
+        }
+        buffer_requeued.notify_one();
+        if(capture_thread.joinable())
+            capture_thread.join();
+        captured_frames.clear();
+        n_dequeued = 0;
+        capture_failed = false;
+
+        if(streaming) {
+            v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            if(v4l2_ioctl(video_device_fd, VIDIOC_STREAMOFF, &type) < 0)
+                failed("Deactivating the stream failed");
+            streaming = false;
+        }
+        for(const mapped_buffer& buffer : buffers)
+            v4l2_munmap(buffer.start, buffer.length);
+        buffers.clear();
+
+        if(video_device_fd >= 0)
+            v4l2_close(video_device_fd);
+        video_device_fd = -1;
+        capture_options.clear();
+        capture_modes.clear();
+        current_capture_mode = 0;
     }
 
+    //The camera controls, preceded by the capture modes the device offers as a read-only menu (the mode can only be
+    //chosen when opening the device, as the stream has to be stopped to change it)
     std::vector<v4l2_option> list_options() {
-        return capture_options;
+        std::vector<v4l2_option> options;
+        if(!capture_modes.empty()) {
+            v4l2_option capture_mode_option = {0};
+            capture_mode_option.id = capture_mode_option_id;
+            capture_mode_option.name = "Capture mode";
+            capture_mode_option.type = v4l2_option_type::MENU;
+            capture_mode_option.maximum = static_cast<int>(capture_modes.size()) - 1;
+            capture_mode_option.current = static_cast<int>(current_capture_mode);
+            capture_mode_option.read_only = true;
+            for(const capture_mode& mode : capture_modes)
+                capture_mode_option.menu_entries.push_back(describe(mode));
+            options.push_back(capture_mode_option);
+        }
+        options.insert(options.end(), capture_options.begin(), capture_options.end());
+        return options;
     }
 
     int set_option_value(const v4l2_option& option, const int new_value) {
+        if(option.read_only)
+            return option.current;
+
         v4l2_control control = {0};
         control.id = option.id;
         control.value = new_value;
@@ -182,13 +260,16 @@ public:
             return new_value;
     }
 
+    //Frame rate of the stream, rounded to whole frames per second; 0 if the driver does not report it
     int get_fps() const {
         v4l2_streamparm streamparm = {0};
         streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        if (v4l2_ioctl(video_device_fd, VIDIOC_G_PARM, &streamparm) < 0)
-            return failed("Could not query streamparm");
+        if (v4l2_ioctl(video_device_fd, VIDIOC_G_PARM, &streamparm) < 0) {
+            failed("Could not query streamparm");
+            return 0;
+        }
 
-        return 1000 * streamparm.parm.capture.timeperframe.numerator / streamparm.parm.capture.timeperframe.denominator;
+        return static_cast<int>(std::lround(to_fps(streamparm.parm.capture.timeperframe)));
     }
 
     cv::Size get_frame_size() const {
@@ -197,12 +278,294 @@ public:
 
 
 private:
-    int video_device_fd;
+    //A combination of pixel format, frame size and frame interval the device offers
+    struct capture_mode {
+        unsigned int pixel_format;
+        cv::Size_<unsigned int> frame_size;
+        v4l2_fract frame_interval;
+    };
+
+    const std::vector<cv::Size_<unsigned int>> stepwise_frame_sizes{{320, 240}, {640, 480}, {1280, 720}, {1920, 1080}};
+
+    static double to_fps(const v4l2_fract& frame_interval) {
+        return frame_interval.numerator > 0 ? static_cast<double>(frame_interval.denominator) /
+                                              frame_interval.numerator : 0.;
+    }
+
+    static string fourcc_to_string(const unsigned int fourcc) {
+        return {static_cast<char>(fourcc & 0xff), static_cast<char>((fourcc >> 8) & 0xff),
+                static_cast<char>((fourcc >> 16) & 0xff), static_cast<char>((fourcc >> 24) & 0xff)};
+    }
+
+    static string describe(const capture_mode& mode) {
+        std::ostringstream description;
+        description << fourcc_to_string(mode.pixel_format) << " " << mode.frame_size.width << "x" <<
+                    mode.frame_size.height << " @ " << std::setprecision(3) << to_fps(mode.frame_interval) << " fps";
+        return description.str();
+    }
+
+    //Fills capture_modes with all sizes and intervals the device offers in the given formats. Stepwise and continuous
+    //ranges are represented by the common sizes they contain plus their largest size and, per size, by their shortest
+    //interval and by the target interval.
+    void enumerate_capture_modes(const std::vector<unsigned int>& pixel_formats, const int target_fps) {
+        capture_modes.clear();
+        v4l2_fmtdesc format_description = {0};
+        format_description.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        for(; v4l2_ioctl(video_device_fd, VIDIOC_ENUM_FMT, &format_description) == 0; ++format_description.index) {
+            if(std::find(pixel_formats.begin(), pixel_formats.end(), format_description.pixelformat) ==
+                    pixel_formats.end())
+                continue;
+
+            std::vector<cv::Size_<unsigned int>> frame_sizes;
+            v4l2_frmsizeenum frame_size_description = {0};
+            frame_size_description.pixel_format = format_description.pixelformat;
+            for(; v4l2_ioctl(video_device_fd, VIDIOC_ENUM_FRAMESIZES, &frame_size_description) == 0;
+                    ++frame_size_description.index) {
+                if(frame_size_description.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+                    frame_sizes.push_back({frame_size_description.discrete.width,
+                                           frame_size_description.discrete.height});
+                } else {
+                    const v4l2_frmsize_stepwise& range = frame_size_description.stepwise;
+                    for(const cv::Size_<unsigned int>& size : stepwise_frame_sizes) {
+                        if(size.width >= range.min_width && size.width < range.max_width &&
+                                size.height >= range.min_height && size.height < range.max_height &&
+                                (range.step_width == 0 || (size.width - range.min_width) % range.step_width == 0) &&
+                                (range.step_height == 0 || (size.height - range.min_height) % range.step_height == 0))
+                            frame_sizes.push_back(size);
+                    }
+                    frame_sizes.push_back({range.max_width, range.max_height});
+                    break;
+                }
+            }
+
+            for(const cv::Size_<unsigned int>& size : frame_sizes) {
+                v4l2_frmivalenum interval_description = {0};
+                interval_description.pixel_format = format_description.pixelformat;
+                interval_description.width = size.width;
+                interval_description.height = size.height;
+                for(; v4l2_ioctl(video_device_fd, VIDIOC_ENUM_FRAMEINTERVALS, &interval_description) == 0;
+                        ++interval_description.index) {
+                    if(interval_description.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+                        capture_modes.push_back({format_description.pixelformat, size, interval_description.discrete});
+                        continue;
+                    }
+                    const v4l2_fract& shortest = interval_description.stepwise.min;
+                    const v4l2_fract& longest = interval_description.stepwise.max;
+                    capture_modes.push_back({format_description.pixelformat, size, shortest});
+                    const double target = static_cast<double>(target_fps);
+                    if(target < to_fps(shortest) && target >= to_fps(longest))
+                        capture_modes.push_back({format_description.pixelformat, size,
+                                                 {1, static_cast<unsigned int>(target_fps)}});
+                    break;
+                }
+            }
+        }
+    }
+
+    //Index of the mode in capture_modes that best fits the request, see capture_request. Every captured frame is
+    //processed, so a mode costs its pixels times its own rate. Among equally large modes, the slowest one that reaches
+    //the target is taken, then the format listed first in pixel_formats.
+    size_t choose_capture_mode(const std::vector<unsigned int>& pixel_formats, const capture_request& request) const {
+        auto format_rank = [&pixel_formats](const capture_mode& mode) {
+            return std::find(pixel_formats.begin(), pixel_formats.end(), mode.pixel_format) - pixel_formats.begin();
+        };
+        auto pixel_rate = [](const capture_mode& mode) {
+            return static_cast<double>(mode.frame_size.width) * mode.frame_size.height * to_fps(mode.frame_interval);
+        };
+        auto area = [](const capture_mode& mode) {
+            return mode.frame_size.width * mode.frame_size.height;
+        };
+        //Half a frame of tolerance, so that e.g. 29.97 fps count as 30
+        auto reaches_target = [&request](const capture_mode& mode) {
+            return to_fps(mode.frame_interval) + .5 >= request.target_fps;
+        };
+        auto is_better = [&](const capture_mode& mode, const capture_mode& best) {
+            const bool within_budget = pixel_rate(mode) <= request.max_pixel_rate;
+            if(within_budget != (pixel_rate(best) <= request.max_pixel_rate))
+                return within_budget;
+            if(!within_budget)
+                return pixel_rate(mode) < pixel_rate(best);
+            if(reaches_target(mode) != reaches_target(best))
+                return reaches_target(mode);
+            if(!reaches_target(mode) && to_fps(mode.frame_interval) != to_fps(best.frame_interval))
+                return to_fps(mode.frame_interval) > to_fps(best.frame_interval);
+            if(area(mode) != area(best))
+                return area(mode) > area(best);
+            if(to_fps(mode.frame_interval) != to_fps(best.frame_interval))
+                return to_fps(mode.frame_interval) < to_fps(best.frame_interval);
+            return format_rank(mode) < format_rank(best);
+        };
+
+        size_t best_mode = 0;
+        for(size_t mode_id = 1; mode_id < capture_modes.size(); ++mode_id) {
+            if(is_better(capture_modes[mode_id], capture_modes[best_mode]))
+                best_mode = mode_id;
+        }
+        return best_mode;
+    }
+
+    //Sets the pixel format, frame size and frame interval of mode; with fall_back, raw formats are only accepted if the
+    //device delivers exactly that size at no less than that rate, so that a compressed format may be tried instead
+    bool set_format(const capture_mode& mode, const bool fall_back) {
+        v4l2_format format = {0};
+        format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        format.fmt.pix.pixelformat = mode.pixel_format;
+        format.fmt.pix.width = mode.frame_size.width;
+        format.fmt.pix.height = mode.frame_size.height;
+        format.fmt.pix.field = V4L2_FIELD_ANY;
+
+        if(v4l2_ioctl(video_device_fd, VIDIOC_S_FMT, &format) < 0 || format.fmt.pix.pixelformat != mode.pixel_format)
+            return false;
+        const bool is_raw = mode.pixel_format != V4L2_PIX_FMT_MJPEG;
+        if(is_raw && fall_back &&
+                (format.fmt.pix.width != mode.frame_size.width || format.fmt.pix.height != mode.frame_size.height))
+            return false;
+
+        v4l2_streamparm streamparm = {0};
+        streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (v4l2_ioctl(video_device_fd, VIDIOC_G_PARM, &streamparm) < 0)
+            return failed("Could not query streamparm");
+
+        streamparm.parm.capture.capturemode |= V4L2_CAP_TIMEPERFRAME;
+        streamparm.parm.capture.timeperframe = mode.frame_interval;
+        if(v4l2_ioctl(video_device_fd, VIDIOC_S_PARM, &streamparm) < 0)
+            return failed("Could not set streamparm");
+        if(is_raw && fall_back && to_fps(streamparm.parm.capture.timeperframe) < to_fps(mode.frame_interval))
+            return false;
+
+        pixel_format = mode.pixel_format;
+        bytes_per_line = format.fmt.pix.bytesperline;
+        frame_size = cv::Size_<unsigned int>(format.fmt.pix.width, format.fmt.pix.height);
+        return true;
+    }
+
+    //Placeholder in the format read() promises, for frames that could not be captured or decoded
+    cv::Mat get_empty_frame(const bool keep_raw) const {
+        if(keep_raw && pixel_format == V4L2_PIX_FMT_YUYV)
+            return cv::Mat(frame_size.height, frame_size.width, CV_8UC2, cv::Scalar(16, 128));
+        if(keep_raw && pixel_format == V4L2_PIX_FMT_NV12)
+            return cv::Mat(frame_size.height * 3 / 2, frame_size.width, CV_8UC1, cv::Scalar(16));
+        return cv::Mat(100,100,CV_8UC3);
+    }
+
+    void read(cv::Mat& out, const bool keep_raw) {
+        captured_frame frame;
+        {
+            std::unique_lock<std::mutex> lock(capture_mutex);
+            if(!frame_captured.wait_for(lock, std::chrono::seconds(1),
+                                        [this]() { return !captured_frames.empty() || capture_failed; })
+                    || captured_frames.empty()) {
+                out = get_empty_frame(keep_raw);
+                return;
+            }
+            frame = captured_frames.front();
+            captured_frames.pop_front();
+        }
+
+        const mapped_buffer& buffer = buffers[frame.buffer.index];
+        if(pixel_format == V4L2_PIX_FMT_YUYV) {
+            const cv::Mat raw_frame(frame_size.height, frame_size.width, CV_8UC2, buffer.start, bytes_per_line);
+            keep_raw ? raw_frame.copyTo(out) : cv::cvtColor(raw_frame, out, CV_YUV2BGR_YUYV);
+        } else if(pixel_format == V4L2_PIX_FMT_NV12) {
+            const cv::Mat raw_frame(frame_size.height * 3 / 2, frame_size.width, CV_8UC1, buffer.start, bytes_per_line);
+            keep_raw ? raw_frame.copyTo(out) : cv::cvtColor(raw_frame, out, CV_YUV2BGR_NV12);
+        } else
+            out = cv::imdecode(cv::Mat(1, static_cast<int>(frame.buffer.bytesused), CV_8UC1, buffer.start),
+                               CV_LOAD_IMAGE_COLOR);
+        if(out.empty())
+            out = get_empty_frame(keep_raw);
+        last_timestamp = frame.timestamp;
+
+        if(v4l2_ioctl(video_device_fd, VIDIOC_QBUF, &frame.buffer) < 0) {
+            failed("Queuing a new buffer failed");
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(capture_mutex);
+            --n_dequeued;
+        }
+        buffer_requeued.notify_one();
+    }
+
+    struct mapped_buffer {
+        unsigned char* start;
+        size_t length;
+    };
+
+    //A dequeued buffer that waits to be decoded
+    struct captured_frame {
+        v4l2_buffer buffer;
+        std::chrono::steady_clock::time_point timestamp;
+    };
+
+    //Capture thread: Dequeues filled buffers as soon as they are ready; polls so that release() is noticed. While the
+    //consumer holds all buffers, the driver has none to fill, so the thread waits for one to be requeued.
+    void capture_loop() {
+        pollfd poll_fd = {video_device_fd, POLLIN, 0};
+        while(true) {
+            {
+                std::unique_lock<std::mutex> lock(capture_mutex);
+                buffer_requeued.wait(lock, [this]() { return shutdown || n_dequeued < buffers.size(); });
+                if(shutdown)
+                    return;
+            }
+            const int poll_result = poll(&poll_fd, 1, 100);
+            if(poll_result == 0 || (poll_result < 0 && errno == EINTR))
+                continue;
+
+            captured_frame frame;
+            frame.buffer = {0};
+            frame.buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            frame.buffer.memory = V4L2_MEMORY_MMAP;
+            if(poll_result < 0 || v4l2_ioctl(video_device_fd, VIDIOC_DQBUF, &frame.buffer) < 0) {
+                if(errno == EAGAIN)
+                    continue;
+                failed("Grabbing the current output frame failed");
+                std::lock_guard<std::mutex> lock(capture_mutex);
+                capture_failed = true;
+                frame_captured.notify_all();
+                return;
+            }
+            frame.timestamp = to_steady_clock(frame.buffer);
+
+            std::lock_guard<std::mutex> lock(capture_mutex);
+            captured_frames.push_back(frame);
+            ++n_dequeued;
+            frame_captured.notify_all();
+        }
+    }
+
+    //Driver timestamps on CLOCK_MONOTONIC are on the same clock as std::chrono::steady_clock on Linux; others are
+    //replaced with the time of dequeuing
+    static std::chrono::steady_clock::time_point to_steady_clock(const v4l2_buffer& buffer) {
+        if((buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+            return std::chrono::steady_clock::now();
+        return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::seconds(buffer.timestamp.tv_sec) + std::chrono::microseconds(buffer.timestamp.tv_usec)));
+    }
+
+    int video_device_fd = -1;
+    bool streaming = false;
+    unsigned int pixel_format = V4L2_PIX_FMT_MJPEG;
+    size_t bytes_per_line = 0;
+
+    std::vector<mapped_buffer> buffers;
+    std::chrono::steady_clock::time_point last_timestamp;
 
-    v4l2_buffer bufferinfo;
-    unsigned char* buffer = nullptr;
+    //Shared with the capture thread
+    std::thread capture_thread;
+    std::mutex capture_mutex;
+    std::condition_variable frame_captured;
+    std::condition_variable buffer_requeued;
+    std::deque<captured_frame> captured_frames;
+    size_t n_dequeued = 0; //Buffers that are captured or being decoded, i.e. not with the driver
+    bool capture_failed = false;
+    bool shutdown = false;
 
     std::vector<v4l2_option> capture_options;
+    std::vector<capture_mode> capture_modes;
+    size_t current_capture_mode = 0;
+    static const int capture_mode_option_id = 0; //Not a valid control id
 
     cv::Size_<unsigned int> frame_size;
 };
@@ -17,12 +17,80 @@ along with this program. If not, see <http://www.gnu.org/licenses/>. */
 #ifndef ANALYSIS_H
 #define ANALYSIS_H
 
-#include <helpers/data_container.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
 #include <helpers/common.h>
 
-namespace analysis {
-    analysis_data analyze_heartbeat(parameter_store& params, DataContainer& data_container);
-}
+/**
+* Heartbeat analysis on its own thread: The processing thread hands over the means of all ROIs of each frame with
+* push(), which never waits for the analysis. The analysis thread keeps the last n_buffered_frames means per ROI and
+* channel and updates their
+* spectrum incrementally (a sliding DFT, one complex multiply-add per bin and sample); the plot data is derived from it
+* at most params.analysis_update_rate times per second and picked up with poll(). The heartbeat is estimated to a
+* fraction of a DFT bin by zooming into the heart-rate band, so a window of a few seconds suffices.
+*/
+class HeartbeatAnalyzer {
+public:
+    HeartbeatAnalyzer();
+    HeartbeatAnalyzer(const HeartbeatAnalyzer&) = delete;
+
+    ~HeartbeatAnalyzer();
+
+    //Queues the ROI means of the next frame, in the order of get_roi_rects(); a change of fps, n_buffered_frames or the
+    //number of ROIs restarts the history
+    void push(const std::vector<cv::Scalar>& roi_means, const parameter_store& params);
+
+    //Takes the newest results (one per ROI) published since the last call, returns false if there are none
+    bool poll(std::vector<analysis_data>& results);
+
+    //Waits until all queued means are analysed and returns the analysis of the current history, e.g. at the end of a
+    //video; empty if no mean was pushed
+    std::vector<analysis_data> finish();
+
+private:
+    struct roi_sample {
+        std::vector<cv::Scalar> means;
+        int fps;
+        int n_buffered_frames;
+        int n_channels;
+        float update_rate;
+    };
+
+    void analysis_loop();
+    void add_sample(const roi_sample& sample);
+    void refresh_spectrum();
+    std::vector<analysis_data> analyze() const;
+    double estimate_heartbeat(const int row) const;
+
+    //Shared with the analysis thread
+    std::thread analysis_thread;
+    std::mutex analysis_mutex;
+    std::condition_variable samples_queued;
+    std::condition_variable finish_done;
+    std::deque<roi_sample> pending_samples;
+    std::vector<analysis_data> latest_results;
+    bool has_new_result = false;
+    bool finish_requested = false;
+    bool shutdown = false;
 
+    //Only used by the analysis thread: the ROI means in ring order and their DFT bins (interleaved real and imaginary
+    //parts, bin k of sample position p weighted with exp(-2*pi*i*k*p/n_frames)), one row per ROI and channel
+    int fps = 0;
+    int n_frames = 0;
+    int n_channels = 0;
+    int n_rois = 0;
+    int position = 0;
+    int n_updates = 0;
+    std::chrono::steady_clock::duration update_period;
+    cv::Mat_<double> history;
+    cv::Mat_<double> bins;
+};
 
 #endif //ANALYSIS_H
@@ -0,0 +1,70 @@
+/* VideoMagnification - Magnify motions and detect heartbeats
+Copyright (C) 2016 Christian Diller
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef FACE_TRACKER_H
+#define FACE_TRACKER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/objdetect.hpp>
+
+/**
+* Detects and follows a single(!) face using OpenCV's CascadeClassifier and a pretrained classifier
+* The classifier is loaded once; detection runs every detection_interval frames on a downscaled grayscale copy on a
+* background thread, so update() never blocks on it. In between, the face is followed by template matching.
+* All detections are combined into one cv::Rect; a rect with the size of the frame is returned until a face is found.
+*/
+class FaceTracker {
+public:
+    FaceTracker(const std::string classifier_file, const int _detection_interval = 15, const int _detection_width = 320);
+    FaceTracker(const FaceTracker&) = delete;
+
+    ~FaceTracker();
+
+    //Takes an 8 bit BGR or grayscale frame and returns the current face rect in frame coordinates
+    cv::Rect update(const cv::Mat& frame);
+
+private:
+    void detection_loop();
+    void track(const cv::Mat& small_gray_frame);
+
+    cv::CascadeClassifier classifier;
+    const int detection_interval;
+    const int detection_width;
+
+    //Shared with the detection thread
+    std::thread detection_thread;
+    std::mutex detection_mutex;
+    std::condition_variable detection_condition;
+    cv::Mat detection_input;
+    cv::Rect detection_result;
+    bool detection_pending = false;
+    bool detection_finished = false;
+    bool shutdown = false;
+
+    //Only used by the calling thread; all rects are in downscaled coordinates
+    int frame_id = 0;
+    double scale = 1.0;
+    cv::Rect tracked_rect;
+    cv::Mat face_template;
+};
+
+#endif //FACE_TRACKER_H
@@ -0,0 +1,63 @@
+/* VideoMagnification - Magnify motions and detect heartbeats
+Copyright (C) 2016 Christian Diller
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef FRAME_CONVERSION_H
+#define FRAME_CONVERSION_H
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <helpers/common.h>
+
+namespace frame_conversion {
+
+    /**
+    * Converts the regions (see get_converted_regions()) of a frame as read from the video source into the float
+    * working format, i.e. the colour space given by color_convert_forward (BGR if it is not positive). frame_float gets
+    * the size of the frame, but its pixels outside the regions are left as they are. Raw YUYV and NV12 frames are read
+    * plane by plane straight into float BGR or YCrCb, without an 8 bit BGR frame in between; other working colour
+    * spaces take the detour via BGR. The intermediate matrices are taken from allocator, e.g. a BufferPool, if given.
+    */
+    void to_working_format(const cv::Mat& frame, const pixel_format_type pixel_format, const int color_convert_forward,
+                           const std::vector<cv::Rect>& regions, cv::Mat_<cv::Vec3f>& frame_float,
+                           cv::MatAllocator* allocator = nullptr);
+
+    //Replaces frame, as read from the video source, by the 8 bit BGR output frame: the regions are converted back from
+    //frame_float with color_convert_backward, the pixels outside them pass through unchanged (converted to BGR if raw);
+    //the BGR frame and the intermediate matrices are taken from allocator if given
+    void to_output_format(const cv::Mat_<cv::Vec3f>& frame_float, const std::vector<cv::Rect>& regions,
+                          const int color_convert_backward, const pixel_format_type pixel_format, cv::Mat& frame,
+                          cv::MatAllocator* allocator = nullptr);
+
+    //8 bit BGR version of the frame, created by allocator if given; BGR frames are returned as they are
+    cv::Mat to_bgr(const cv::Mat& frame, const pixel_format_type pixel_format, cv::MatAllocator* allocator = nullptr);
+
+    //8 bit luma of the frame; for YUYV and NV12, this is the luma plane as sent by the camera
+    cv::Mat get_luma(const cv::Mat& frame, const pixel_format_type pixel_format);
+
+    //Moves the layer channels (see get_region_params()) of a region of the float frame into a matrix of their own,
+    //created by allocator if given, and zeroes them in the region; the other channels keep their input values
+    cv::Mat take_layer_channels(cv::Mat_<cv::Vec3f> region, const std::vector<int>& layer_channels,
+                                cv::MatAllocator* allocator = nullptr);
+
+    //Adds the reconstructed layer channels to their channels of the region, i.e. the inverse of take_layer_channels
+    void add_layer_channels(const cv::Mat& reconstructed, const std::vector<int>& layer_channels,
+                            cv::Mat_<cv::Vec3f> region);
+
+}
+
+#endif //FRAME_CONVERSION_H
@@ -0,0 +1,46 @@
+/* VideoMagnification - Magnify motions and detect heartbeats
+Copyright (C) 2016 Christian Diller
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef MAGNIFICATION_H
+#define MAGNIFICATION_H
+
+#include <functional>
+
+#include <helpers/data_container.h>
+#include <include/processing/analysis.h>
+
+namespace magnification {
+    //Reads the next 8 bit frame, returns false at the end of the video
+    typedef std::function<bool(cv::Mat&)> frame_source;
+    //Consumes an 8 bit output frame
+    typedef std::function<void(cv::Mat&)> frame_sink;
+
+    //Runs spatial decomposition, temporal filtering and reconstruction on the frame pushed to data_container
+    void magnify_frame(parameter_store& params, DataContainer& data_container);
+
+    /**
+    * Two-pass ideal filtering of a whole video of up to params.n_buffered_frames frames: The first pass decomposes all
+    * frames into the temporal buffers, then every timeseries is transformed exactly once, i.e. O(F log F) instead of
+    * O(F^2 log F) for F frames processed one by one. After rewind, the second pass reconstructs all frames from the
+    * filtered layers. Unlike frame by frame processing, each frame is filtered with the entire video. With
+    * analyze_heartbeat, the ROI means of the magnified frames are handed to analyzer. Returns the number of frames.
+    * With extra ROIs, each processing region is buffered and filtered on its own.
+    */
+    int magnify_video_offline(parameter_store& params, frame_source source, std::function<void()> rewind,
+                              frame_sink sink, HeartbeatAnalyzer* analyzer = nullptr);
+}
+
+#endif //MAGNIFICATION_H
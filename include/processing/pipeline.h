@@ -0,0 +1,103 @@
+/* VideoMagnification - Magnify motions and detect heartbeats
+Copyright (C) 2016 Christian Diller
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <helpers/buffer_pool.h>
+#include <helpers/common.h>
+#include <helpers/ring_queue.h>
+#include <include/processing/analysis.h>
+
+//Everything that belongs to a single frame while it travels through the pipeline
+struct frame_packet {
+    parameter_store params; //The parameters this frame is processed with
+    cv::Mat frame; //Input frame as read, replaced by the 8 bit output frame during reconstruction
+    pixel_format_type pixel_format = pixel_format_type::BGR; //Of the input frame
+    cv::Mat_<cv::Vec3f> frame_float; //Float ROIs (get_converted_regions()); active channels are zeroed in decomposition
+    std::vector<cv::Rect> regions; //The merged ROIs that are filtered, see get_processing_regions()
+    std::vector<std::vector<cv::Mat>> layers; //Pyramid of the active channels of each region
+
+    //Preview information set by the source stage
+    cv::Rect selection_rect;
+    cv::Scalar selection_color;
+    bool first_playback = true;
+    std::chrono::steady_clock::time_point capture_time; //For measuring the latency from capture to output
+
+    bool end_of_stream = false;
+};
+
+struct queue_status {
+    std::string name;
+    size_t depth;
+    size_t occupancy;
+    size_t max_occupancy;
+};
+
+/**
+* Processes frames in five stages that run on their own threads and are connected by bounded ring queues:
+* decode (source), colour conversion and decomposition, temporal filtering, reconstruction and analysis and
+* encode/preview (sink). Throughput is thus limited by the slowest stage instead of the sum of all stages.
+* With analyze_heartbeat, the ROI means of the magnified frames are handed to the given analyzer, which runs on a
+* thread of its own.
+* All ROIs share decoding and colour conversion; overlapping ROIs also share one pyramid and one temporal state.
+* The float frames, pyramids and conversion buffers of all packets are recycled through a BufferPool.
+*/
+class FramePipeline {
+public:
+    //The source fills in frame and params and returns false at the end of the stream; the sink consumes the output
+    typedef std::function<bool(frame_packet&)> source_stage;
+    typedef std::function<void(frame_packet&)> sink_stage;
+
+    FramePipeline(const size_t queue_depth = 4, HeartbeatAnalyzer* _analyzer = nullptr);
+    FramePipeline(const FramePipeline&) = delete;
+    ~FramePipeline();
+
+    //Blocks until the source reports the end of the stream and all frames are drained; to stop the pipeline early,
+    //the source returns false, e.g. once a shutdown flag is set
+    void run(source_stage source, sink_stage sink);
+
+    std::vector<queue_status> get_queue_status() const;
+
+    //Matrix allocations the buffer pools of all stages could not serve from recycled matrices
+    size_t get_n_allocations() const noexcept;
+
+private:
+    void decomposition_stage();
+    void temporal_stage();
+    void reconstruction_stage();
+
+    RingQueue<frame_packet> decoded_frames;
+    RingQueue<frame_packet> decomposed_frames;
+    RingQueue<frame_packet> filtered_frames;
+    RingQueue<frame_packet> reconstructed_frames;
+
+    HeartbeatAnalyzer* analyzer;
+
+    BufferPool* buffer_pool;
+    std::atomic<size_t> n_temporal_allocations; //Those of the temporal stage's DataContainers
+};
+
+#endif //PIPELINE_H
@@ -24,6 +24,15 @@ namespace spatial_filter {
     void spatial_decomp(parameter_store& params, DataContainer &data_container);
     void spatial_comp(parameter_store& params, DataContainer& data_container);
 
+    //Pyramid construction and collapse on plain float matrices with any number of channels, independent of any
+    //DataContainer; all matrices they create are taken from allocator, e.g. a BufferPool, if given
+    void build_pyramid(const cv::Mat& roi, const int n_layers, std::vector<cv::Mat>& layers,
+                       cv::MatAllocator* allocator = nullptr);
+    cv::Mat collapse_pyramid(const std::vector<cv::Mat>& layers, cv::MatAllocator* allocator = nullptr);
+
+    //Approximate Riesz transform of a Laplacian layer with the 3-tap differences [0.5, 0, -0.5] along x and y
+    void riesz_transform(const cv::Mat& layer, cv::Mat& riesz_x, cv::Mat& riesz_y, cv::MatAllocator* allocator = nullptr);
+
 }
 
 #endif //SPATIAL_FILTER_H
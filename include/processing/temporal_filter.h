@@ -22,6 +22,12 @@ along with this program. If not, see <http://www.gnu.org/licenses/>. */
 namespace temporal_filter {
     void ideal_filter(parameter_store& params, DataContainer& data_container);
     void iir_filter(parameter_store& params, DataContainer& data_container);
+
+    //Phase-based magnification of Laplacian layers (spatial filter RIESZ), filtered with the IIR lowpass pair
+    void riesz_filter(parameter_store& params, DataContainer& data_container);
+
+    //Filters the first n_frames samples of every buffered timeseries at once and replaces them with the result
+    void ideal_filter_offline(parameter_store& params, DataContainer& data_container, const int n_frames);
 }
 
 #endif //TEMPORAL_FILTER_H
@@ -17,6 +17,8 @@ along with this program. If not, see <http://www.gnu.org/licenses/>. */
 #ifndef VIDEO_SOURCE_H
 #define VIDEO_SOURCE_H
 
+#include <chrono>
+
 #include <opencv2/videoio.hpp>
 #include <helpers/common.h>
 
@@ -34,11 +36,20 @@ public:
     ~VideoSource();
 
     bool open(const std::string video_filename);
-    bool open(const int video_device);
+    bool open(const int video_device, const int n_capture_buffers = 4,
+              const capture_request& request = capture_request());
 
     void release();
 
     void operator>>(cv::Mat& out) noexcept;
+
+    //Reads the next frame like operator>>, but raw frames of video devices are passed on without conversion to BGR;
+    //get_raw_pixel_format() tells their format
+    void read_raw(cv::Mat& out) noexcept;
+    pixel_format_type get_raw_pixel_format() const noexcept;
+
+    //When the frame read last was captured: the driver's timestamp with V4L2, otherwise the time it was read
+    std::chrono::steady_clock::time_point get_capture_time() const noexcept;
     int get_fps() const noexcept;
     int get_n_frames() const noexcept;
 
@@ -46,6 +57,7 @@ public:
     void start_from_beginning();
     const bool is_first_playback();
 
+    //Camera controls; with V4L2, the first entry is the read-only menu of capture modes the device offers
     std::vector<v4l2_option> list_options();
     int set_option_value(const v4l2_option& option, const int new_value);
 
@@ -53,6 +65,7 @@ private:
     cv::VideoCapture video_source;
     bool first_playback;
     bool is_live_feed;
+    std::chrono::steady_clock::time_point capture_time;
 #ifdef V4L2_CAPTURE
     V4L2Capture video_source_v4l2;
 #endif
@@ -0,0 +1,512 @@
+/* VideoMagnification - Magnify motions and detect heartbeats
+Copyright (C) 2016 Christian Diller
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+//STL
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//OpenCV
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+//Project internal
+#include <video_source.h>
+#include <helpers/fftw_planner.h>
+#include <helpers/task_pool.h>
+#include <include/processing/frame_conversion.h>
+#include <include/processing/magnification.h>
+#include <include/processing/pipeline.h>
+#include <include/processing/analysis.h>
+
+using std::string;
+
+const char* command_line_keys =
+        "{help h usage ?            |             | print this message }"
+        "{@input                    |             | input video file }"
+        "{@output                   |             | output video file; nothing is written if omitted }"
+        "{device                    | -1          | read from the video device with this id instead of a file }"
+        "{capture_buffers           | 4           | number of driver buffers the video device captures into }"
+        "{capture_format            | auto        | auto, mjpeg, yuyv or nv12; auto prefers the raw formats if the device delivers them at full rate }"
+        "{capture_fps               | 30          | frame rate the capture mode of the video device should reach }"
+        "{max_pixel_rate            | 9.216       | processing budget in megapixels per second; the largest capture mode within it is chosen }"
+        "{list_capture_modes        | false       | print the capture modes and controls of the video device and exit }"
+        "{spatial_filter            | laplacian   | none, gaussian, laplacian or riesz; riesz magnifies the phase with the iir cutoffs }"
+        "{temporal_filter           | ideal       | ideal or iir }"
+        "{ideal_filter_engine       | fftw        | fftw or sliding_dft; sliding_dft only updates the passband bins per frame }"
+        "{color_space               | bgr         | bgr, xyz, ycrcb, hsv, lab, luv or yuv; sets color_convert_forward/backward }"
+        "{active_channels           | 111         | one digit per channel, e.g. 100 to only magnify the first channel }"
+        "{roi_rect                  |             | region of interest as x,y,width,height; whole frame if omitted }"
+        "{extra_rois                |             | further regions of interest as x,y,width,height;x,y,width,height;... }"
+        "{n_buffered_frames         | 0           | number of buffered frames; defaults to buffered_seconds * fps }"
+        "{buffered_seconds          | 5           | number of buffered seconds, used if n_buffered_frames is 0 }"
+        "{n_layers                  | 3           | number of pyramid layers }"
+        "{alpha                     | 50          | amplification factor }"
+        "{lambda_c                  | 100         | spatial wavelength cutoff }"
+        "{min_freq                  | 1           | lower frequency bound in Hz (ideal filter) }"
+        "{max_freq                  | 2           | upper frequency bound in Hz (ideal filter) }"
+        "{cutoffLo                  | 0.25        | lower cutoff (iir filter) }"
+        "{cutoffHi                  | 0.6         | higher cutoff (iir filter) }"
+        "{temporal_buffer_layout    | pixel_major | pixel_major or tiled; tiled makes the per-frame buffer writes contiguous }"
+        "{temporal_buffer_precision | float       | float, half or int16; half and int16 store the ideal filter's history in 16 bit }"
+        "{temporal_buffer_storage   | memory      | memory or mapped_file; mapped_file keeps the temporal buffers in files on disk }"
+        "{temporal_buffer_directory |             | directory for mapped_file temporal buffers on disk; defaults to $XDG_CACHE_HOME or ~/.cache }"
+        "{output_fourcc             | MP42        | fourcc code of the output video compression }"
+        "{convert_whole_video       | false       | buffer the whole input video, i.e. n_buffered_frames = number of frames }"
+        "{offline_filter            | true        | with convert_whole_video and the ideal filter, filter each timeseries once over the whole video in two passes }"
+        "{fps                       | 0           | frames per second; defaults to the input's frame rate }"
+        "{analyze_heartbeat         | false       | analyze the ROI and report the heartbeat at exit }"
+        "{analysis_rate             | 4           | heartbeat analysis results per second, computed on a thread of their own; 0 analyses every frame }"
+        "{pool_buffers              | true        | recycle the per-frame matrices; false allocates them every frame, e.g. to compare frame times }"
+        "{fftw_wisdom               |             | FFTW wisdom cache file; defaults to videomagnification.fftwf_wisdom in $XDG_CACHE_HOME or ~/.cache }"
+        "{pipelined                 | true        | run decode, decomposition, temporal filtering, reconstruction and encode on their own threads }"
+        "{queue_depth               | 4           | number of frames each queue between two pipeline stages can hold }"
+        "{n_frames                  | 0           | stop after this many frames; 0 processes the whole file once }";
+
+inline bool invalid_parameter(const string& why) {
+    std::cerr << why << std::endl;
+    return false;
+}
+
+//Sets color_convert_forward and color_convert_backward; the backward conversion targets BGR for cv::VideoWriter
+bool parse_color_space(const string& color_space, parameter_store& params) {
+    if(color_space == "bgr") { params.color_convert_forward = -1; params.color_convert_backward = -1; }
+    else if(color_space == "xyz") { params.color_convert_forward = CV_BGR2XYZ; params.color_convert_backward = CV_XYZ2BGR; }
+    else if(color_space == "ycrcb") { params.color_convert_forward = CV_BGR2YCrCb; params.color_convert_backward = CV_YCrCb2BGR; }
+    else if(color_space == "hsv") { params.color_convert_forward = CV_BGR2HSV; params.color_convert_backward = CV_HSV2BGR; }
+    else if(color_space == "lab") { params.color_convert_forward = CV_BGR2Lab; params.color_convert_backward = CV_Lab2BGR; }
+    else if(color_space == "luv") { params.color_convert_forward = CV_BGR2Luv; params.color_convert_backward = CV_Luv2BGR; }
+    else if(color_space == "yuv") { params.color_convert_forward = CV_BGR2YUV; params.color_convert_backward = CV_YUV2BGR; }
+    else return false;
+    return true;
+}
+
+inline bool parse_capture_format(const string& name, capture_format_type& capture_format) {
+    if(name == "auto") capture_format = capture_format_type::AUTO;
+    else if(name == "mjpeg") capture_format = capture_format_type::MJPEG;
+    else if(name == "yuyv") capture_format = capture_format_type::YUYV;
+    else if(name == "nv12") capture_format = capture_format_type::NV12;
+    else return false;
+    return true;
+}
+
+//Prints each option with its range, and the entries of menus whose names are known; * marks the current value
+void print_options(const std::vector<v4l2_option>& options) {
+    for(const v4l2_option& option : options) {
+        std::cout << option.name << " [" << option.minimum << ", " << option.maximum << "]: " << option.current <<
+                  (option.read_only ? " (read-only)" : "") << std::endl;
+        for(size_t entry_id = 0; entry_id < option.menu_entries.size(); ++entry_id)
+            std::cout << (option.minimum + static_cast<int>(entry_id) == option.current ? "  * " : "    ") <<
+                      option.menu_entries[entry_id] << std::endl;
+    }
+}
+
+//Reads all parameters from the command line into params; returns false if any of them is invalid
+bool parse_parameters(cv::CommandLineParser& parser, parameter_store& params) {
+    string spatial_filter = parser.get<string>("spatial_filter");
+    if(spatial_filter == "none") params.spatial_filter = spatial_filter_type::NONE;
+    else if(spatial_filter == "gaussian") params.spatial_filter = spatial_filter_type::GAUSSIAN;
+    else if(spatial_filter == "laplacian") params.spatial_filter = spatial_filter_type::LAPLACIAN;
+    else if(spatial_filter == "riesz") params.spatial_filter = spatial_filter_type::RIESZ;
+    else return invalid_parameter("Unknown spatial filter " + spatial_filter);
+
+    string temporal_filter = parser.get<string>("temporal_filter");
+    if(temporal_filter == "ideal") params.temporal_filter = temporal_filter_type::IDEAL;
+    else if(temporal_filter == "iir") params.temporal_filter = temporal_filter_type::IIR;
+    else return invalid_parameter("Unknown temporal filter " + temporal_filter);
+
+    string ideal_filter_engine = parser.get<string>("ideal_filter_engine");
+    if(ideal_filter_engine == "fftw") params.ideal_filter_engine = ideal_filter_engine_type::FFTW;
+    else if(ideal_filter_engine == "sliding_dft") params.ideal_filter_engine = ideal_filter_engine_type::SLIDING_DFT;
+    else return invalid_parameter("Unknown ideal filter engine " + ideal_filter_engine);
+
+    if(!parse_color_space(parser.get<string>("color_space"), params))
+        return invalid_parameter("Unknown color space " + parser.get<string>("color_space"));
+
+    string active_channels = parser.get<string>("active_channels");
+    if(active_channels.size() != params.active_channels.size())
+        return invalid_parameter("active_channels needs exactly one digit per channel");
+    for(int channel_id = 0; channel_id < params.n_channels; ++channel_id)
+        params.active_channels[channel_id] = (active_channels[channel_id] != '0');
+
+    if(parser.has("roi_rect")) {
+        cv::Rect roi_rect;
+        if(std::sscanf(parser.get<string>("roi_rect").c_str(), "%d,%d,%d,%d",
+                       &roi_rect.x, &roi_rect.y, &roi_rect.width, &roi_rect.height) != 4)
+            return invalid_parameter("roi_rect has to be given as x,y,width,height");
+        params.roi_rect = roi_rect;
+    }
+
+    std::istringstream extra_rois(parser.has("extra_rois") ? parser.get<string>("extra_rois") : "");
+    for(string extra_roi; std::getline(extra_rois, extra_roi, ';'); ) {
+        cv::Rect roi_rect;
+        if(std::sscanf(extra_roi.c_str(), "%d,%d,%d,%d", &roi_rect.x, &roi_rect.y, &roi_rect.width, &roi_rect.height) != 4)
+            return invalid_parameter("extra_rois have to be given as x,y,width,height;x,y,width,height;...");
+        params.extra_roi_rects.push_back(roi_rect);
+    }
+
+    params.n_layers = parser.get<int>("n_layers");
+    params.alpha = parser.get<float>("alpha");
+    params.lambda_c = parser.get<float>("lambda_c");
+    params.min_freq = parser.get<float>("min_freq");
+    params.max_freq = parser.get<float>("max_freq");
+    params.cutoffLo = parser.get<float>("cutoffLo");
+    params.cutoffHi = parser.get<float>("cutoffHi");
+
+    string temporal_buffer_layout = parser.get<string>("temporal_buffer_layout");
+    if(temporal_buffer_layout == "pixel_major") params.temporal_buffer_layout = temporal_buffer_layout_type::PIXEL_MAJOR;
+    else if(temporal_buffer_layout == "tiled") params.temporal_buffer_layout = temporal_buffer_layout_type::TILED;
+    else return invalid_parameter("Unknown temporal buffer layout " + temporal_buffer_layout);
+
+    string temporal_buffer_precision = parser.get<string>("temporal_buffer_precision");
+    if(temporal_buffer_precision == "float") params.temporal_buffer_precision = temporal_buffer_precision_type::FLOAT;
+    else if(temporal_buffer_precision == "half") params.temporal_buffer_precision = temporal_buffer_precision_type::HALF;
+    else if(temporal_buffer_precision == "int16") params.temporal_buffer_precision = temporal_buffer_precision_type::INT16;
+    else return invalid_parameter("Unknown temporal buffer precision " + temporal_buffer_precision);
+
+    string temporal_buffer_storage = parser.get<string>("temporal_buffer_storage");
+    if(temporal_buffer_storage == "memory") params.temporal_buffer_storage = temporal_buffer_storage_type::MEMORY;
+    else if(temporal_buffer_storage == "mapped_file") params.temporal_buffer_storage = temporal_buffer_storage_type::MAPPED_FILE;
+    else return invalid_parameter("Unknown temporal buffer storage " + temporal_buffer_storage);
+    params.temporal_buffer_directory = parser.get<string>("temporal_buffer_directory");
+
+    string fourcc = parser.get<string>("output_fourcc");
+    if(fourcc.size() != 4)
+        return invalid_parameter("output_fourcc has to consist of exactly four characters");
+    params.output_fourcc = cv::VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]);
+
+    params.convert_whole_video = parser.get<bool>("convert_whole_video");
+    params.analyze_heartbeat = parser.get<bool>("analyze_heartbeat");
+    params.analysis_update_rate = parser.get<float>("analysis_rate");
+    params.pool_buffers = parser.get<bool>("pool_buffers");
+
+    if(params.n_layers < 1)
+        return invalid_parameter("n_layers has to be at least 1");
+    return parser.check();
+}
+
+//Frame times and matrix allocations (requests the buffer pools could not serve from recycled matrices) of a run
+struct run_statistics {
+    std::vector<double> frame_times; //Milliseconds between two consecutive output frames
+    std::vector<double> latencies; //Milliseconds from capture to output of each frame
+    int n_warmup_frames = 5;
+    size_t n_warmup_allocations = 0; //Matrix allocations within the first n_warmup_frames frames
+    size_t n_steady_allocations = 0; //Matrix allocations afterwards
+};
+
+inline void add_frame_time(run_statistics& statistics, std::chrono::high_resolution_clock::time_point& last_frame) {
+    auto now = std::chrono::high_resolution_clock::now();
+    statistics.frame_times.push_back(std::chrono::duration<double, std::milli>(now - last_frame).count());
+    last_frame = now;
+}
+
+inline void add_latency(run_statistics& statistics, const std::chrono::steady_clock::time_point& capture_time) {
+    statistics.latencies.push_back(
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - capture_time).count());
+}
+
+//Runs all processing steps one after another on the calling thread; returns the number of processed frames
+int run_sequential(VideoSource& video_source, cv::VideoWriter& video_writer, parameter_store& params,
+                   const bool is_live_feed, const int n_frames, HeartbeatAnalyzer& analyzer,
+                   run_statistics& statistics) {
+    //Each region keeps its temporal state in a container of its own, all of them work on the same frame
+    std::vector<parameter_store> region_params;
+    std::vector<std::unique_ptr<DataContainer>> data_containers;
+    for(const cv::Rect& region : get_processing_regions(params)) {
+        region_params.push_back(get_region_params(params, region));
+        data_containers.emplace_back(new DataContainer(region_params.back()));
+    }
+    auto get_n_allocations = [&data_containers]() {
+        size_t n_allocations = 0;
+        for(const std::unique_ptr<DataContainer>& data_container : data_containers)
+            n_allocations += data_container->get_buffer_pool().get_n_allocations();
+        return n_allocations;
+    };
+    const std::vector<cv::Rect> roi_rects = get_roi_rects(params);
+    const std::vector<cv::Rect> converted_regions = get_converted_regions(params);
+    BufferPool& buffer_pool = data_containers.front()->get_buffer_pool();
+    cv::Mat frame;
+    cv::Mat_<cv::Vec3f> frame_float;
+    int n_processed_frames = 0;
+    auto last_frame = std::chrono::high_resolution_clock::now();
+    while(n_frames <= 0 || n_processed_frames < n_frames) {
+        video_source.read_raw(frame);
+        if(!is_live_feed && !video_source.is_first_playback()) //The input video has been completely processed
+            break;
+
+        frame_float = buffer_pool.matrix<cv::Vec3f>();
+        frame_conversion::to_working_format(frame, video_source.get_raw_pixel_format(), params.color_convert_forward,
+                                            converted_regions, frame_float, &buffer_pool);
+        cv::Mat_<cv::Vec3f> magnified_frame;
+        for(size_t region_id = 0; region_id < data_containers.size(); ++region_id) {
+            data_containers[region_id]->push_frame(frame_float, region_params[region_id]);
+            magnification::magnify_frame(region_params[region_id], *data_containers[region_id]);
+            magnified_frame = data_containers[region_id]->pop_frame();
+        }
+        FFTWPlanner::instance().release_unused(); //All regions have requested their plans of this frame
+        if(params.analyze_heartbeat) {
+            std::vector<cv::Scalar> roi_means;
+            for(const cv::Rect& roi_rect : roi_rects)
+                roi_means.push_back(cv::mean(magnified_frame(roi_rect)));
+            analyzer.push(roi_means, params);
+        }
+        frame_conversion::to_output_format(magnified_frame, converted_regions, params.color_convert_backward,
+                                           video_source.get_raw_pixel_format(), frame, &buffer_pool);
+
+        if(params.write_to_file)
+            video_writer.write(frame);
+        add_latency(statistics, video_source.get_capture_time());
+
+        if(++n_processed_frames == statistics.n_warmup_frames)
+            statistics.n_warmup_allocations = get_n_allocations();
+        add_frame_time(statistics, last_frame);
+    }
+    if(n_processed_frames > statistics.n_warmup_frames)
+        statistics.n_steady_allocations = get_n_allocations() - statistics.n_warmup_allocations;
+    else
+        statistics.n_warmup_allocations = get_n_allocations();
+    return n_processed_frames;
+}
+
+//Filters the whole video at once with the two-pass offline ideal filter; returns the number of processed frames
+int run_offline(VideoSource& video_source, cv::VideoWriter& video_writer, parameter_store& params,
+                HeartbeatAnalyzer& analyzer) {
+    return magnification::magnify_video_offline(
+            params,
+            [&](cv::Mat& frame) {
+                video_source >> frame;
+                return video_source.is_first_playback() && !frame.empty();
+            },
+            [&]() { video_source.start_from_beginning(); },
+            [&](cv::Mat& frame) {
+                if(params.write_to_file)
+                    video_writer.write(frame);
+            },
+            &analyzer);
+}
+
+//Runs the processing steps as a FramePipeline with one thread per stage; returns the number of processed frames
+int run_pipelined(FramePipeline& pipeline, VideoSource& video_source, cv::VideoWriter& video_writer,
+                  parameter_store& params, const bool is_live_feed, const int n_frames, run_statistics& statistics) {
+    int n_decoded_frames = 0, n_processed_frames = 0;
+    auto last_frame = std::chrono::high_resolution_clock::now();
+    pipeline.run(
+            [&](frame_packet& packet) {
+                if(n_frames > 0 && n_decoded_frames >= n_frames)
+                    return false;
+                video_source.read_raw(packet.frame);
+                if(!is_live_feed && !video_source.is_first_playback()) //The input video has been completely processed
+                    return false;
+                packet.pixel_format = video_source.get_raw_pixel_format();
+                packet.params = params;
+                packet.capture_time = video_source.get_capture_time();
+                ++n_decoded_frames;
+                return true;
+            },
+            [&](frame_packet& packet) {
+                if(packet.params.write_to_file)
+                    video_writer.write(packet.frame);
+                if(++n_processed_frames == statistics.n_warmup_frames)
+                    statistics.n_warmup_allocations = pipeline.get_n_allocations();
+                add_frame_time(statistics, last_frame);
+                add_latency(statistics, packet.capture_time);
+            });
+    if(n_processed_frames > statistics.n_warmup_frames)
+        statistics.n_steady_allocations = pipeline.get_n_allocations() - statistics.n_warmup_allocations;
+    else
+        statistics.n_warmup_allocations = pipeline.get_n_allocations();
+    return n_processed_frames;
+}
+
+//Mean and maximum time from capture (the driver's timestamp for video devices) to output
+void report_latencies(const std::vector<double>& latencies) {
+    if(latencies.empty())
+        return;
+    double mean = 0.0;
+    for(double latency : latencies)
+        mean += latency / latencies.size();
+    std::printf("Latency from capture to output: mean %.2f ms, max. %.2f ms\n",
+                mean, *std::max_element(latencies.begin(), latencies.end()));
+}
+
+//Mean, standard deviation, 99th percentile and maximum of the frame times, i.e. the latency jitter
+void report_frame_times(std::vector<double> frame_times) {
+    if(frame_times.empty())
+        return;
+    double mean = 0.0, variance = 0.0;
+    for(double frame_time : frame_times)
+        mean += frame_time / frame_times.size();
+    for(double frame_time : frame_times)
+        variance += (frame_time - mean) * (frame_time - mean) / frame_times.size();
+    std::sort(frame_times.begin(), frame_times.end());
+    std::printf("Frame time: mean %.2f ms, std. deviation %.2f ms, 99th percentile %.2f ms, max. %.2f ms\n",
+                mean, std::sqrt(variance), frame_times[(frame_times.size() - 1) * 99 / 100], frame_times.back());
+}
+
+int main(int argc, char** argv) {
+    cv::CommandLineParser parser(argc, argv, command_line_keys);
+    parser.about("vmag-cli - Magnify motions and detect heartbeats without a GUI");
+    if(parser.has("help") || (parser.get<string>("@input").empty() && parser.get<int>("device") < 0)) {
+        parser.printMessage();
+        return 0;
+    }
+
+    parameter_store params;
+    reset_parameters(params);
+    if(!parse_parameters(parser, params)) {
+        parser.printErrors();
+        return 1;
+    }
+
+    //Plans measured in earlier runs are available right away
+    const string wisdom_filename = parser.get<string>("fftw_wisdom").empty() ? FFTWPlanner::default_wisdom_filename() :
+                                   parser.get<string>("fftw_wisdom");
+    FFTWPlanner::instance().load_wisdom(wisdom_filename);
+
+    //Open the video input
+    VideoSource video_source;
+    const bool is_live_feed = parser.get<int>("device") >= 0;
+    const string input = is_live_feed ? std::to_string(parser.get<int>("device")) : parser.get<string>("@input");
+    capture_request request;
+    if(!parse_capture_format(parser.get<string>("capture_format"), request.format)) {
+        std::cerr << "Unknown capture format " << parser.get<string>("capture_format") << std::endl;
+        return 1;
+    }
+    request.target_fps = parser.get<int>("capture_fps");
+    request.max_pixel_rate = parser.get<double>("max_pixel_rate") * 1e6;
+    if(!(is_live_feed ? video_source.open(parser.get<int>("device"), parser.get<int>("capture_buffers"), request) :
+                        video_source.open(input))) {
+        std::cerr << "Could not open video input " << input << std::endl;
+        return 1;
+    }
+    if(parser.get<bool>("list_capture_modes")) {
+        print_options(video_source.list_options());
+        return 0;
+    }
+
+    params.fps = parser.get<int>("fps") > 0 ? parser.get<int>("fps") : video_source.get_fps();
+    if(params.fps <= 0) {
+        std::cerr << "Could not determine the frame rate of " << input << "; please set fps" << std::endl;
+        return 1;
+    }
+
+    if(params.convert_whole_video && !is_live_feed) {
+        params.n_buffered_frames = video_source.get_n_frames();
+        if(params.n_buffered_frames <= 0) {
+            std::cerr << "Could not determine the number of frames of " << input << std::endl;
+            return 1;
+        }
+    } else if(parser.get<int>("n_buffered_frames") > 0)
+        params.n_buffered_frames = parser.get<int>("n_buffered_frames");
+    else
+        params.n_buffered_frames = parser.get<int>("buffered_seconds") * params.fps;
+
+    const cv::Size frame_size = video_source.get_frame_size();
+    if(params.roi_rect.area() == 0)
+        params.roi_rect = cv::Rect(cv::Point(0, 0), frame_size);
+    params.roi_rect = align_rect(params.roi_rect & cv::Rect(cv::Point(0, 0), frame_size), params.n_layers);
+    for(cv::Rect& roi_rect : params.extra_roi_rects) {
+        roi_rect = align_rect(roi_rect & cv::Rect(cv::Point(0, 0), frame_size), params.n_layers);
+        if(roi_rect.area() == 0) {
+            std::cerr << "Extra ROIs have to overlap the frame" << std::endl;
+            return 1;
+        }
+    }
+
+    //Open the video output
+    cv::VideoWriter video_writer;
+    if(!parser.get<string>("@output").empty()) {
+        params.video_output_filename = parser.get<string>("@output");
+        params.write_to_file = video_writer.open(params.video_output_filename, params.output_fourcc,
+                                                 params.fps, frame_size);
+        if(!params.write_to_file) {
+            std::cerr << "Could not open video output " << params.video_output_filename << std::endl;
+            return 1;
+        }
+    }
+
+    const int n_frames = parser.get<int>("n_frames");
+    if(is_live_feed && n_frames <= 0) {
+        std::cerr << "Please set n_frames when reading from a video device" << std::endl;
+        return 1;
+    }
+
+    //Process frames as fast as possible, i.e. without waiting for the next frame to be due
+    HeartbeatAnalyzer analyzer;
+    run_statistics statistics;
+    const bool offline = params.convert_whole_video && !is_live_feed && parser.get<bool>("offline_filter") &&
+                         params.temporal_filter == temporal_filter_type::IDEAL &&
+                         params.spatial_filter != spatial_filter_type::NONE &&
+                         params.spatial_filter != spatial_filter_type::RIESZ;
+    const bool pipelined = parser.get<bool>("pipelined") && !offline;
+    const size_t queue_depth = static_cast<size_t>(std::max(parser.get<int>("queue_depth"), 1));
+    FramePipeline pipeline(queue_depth, &analyzer);
+    if(pipelined) //The frames in the four queues are allocated before the first of them are recycled
+        statistics.n_warmup_frames += 4 * static_cast<int>(queue_depth);
+    TaskPool::instance().reset_utilisation();
+    auto start = std::chrono::high_resolution_clock::now();
+    int n_processed_frames;
+    if(offline)
+        n_processed_frames = run_offline(video_source, video_writer, params, analyzer);
+    else if(pipelined)
+        n_processed_frames = run_pipelined(pipeline, video_source, video_writer, params, is_live_feed, n_frames,
+                                           statistics);
+    else
+        n_processed_frames = run_sequential(video_source, video_writer, params, is_live_feed, n_frames,
+                                            analyzer, statistics);
+    auto end = std::chrono::high_resolution_clock::now();
+    video_writer.release();
+
+    //Report statistics
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << "Processed " << n_processed_frames << " frames in " << seconds << " s ("
+              << (seconds > 0 ? n_processed_frames / seconds : 0.0) << " frames/sec)" << std::endl;
+    report_frame_times(statistics.frame_times);
+    report_latencies(statistics.latencies);
+    if(!offline)
+        std::cout << "Matrix allocations: " << statistics.n_warmup_allocations << " within the first "
+                  << statistics.n_warmup_frames << " frames, " << statistics.n_steady_allocations << " afterwards"
+                  << std::endl;
+    if(pipelined) {
+        for(const queue_status& status : pipeline.get_queue_status())
+            std::cout << "Queue " << status.name << ": depth " << status.depth
+                      << ", max. occupancy " << status.max_occupancy << std::endl;
+    }
+    const std::vector<worker_utilisation> utilisation = TaskPool::instance().get_utilisation();
+    for(size_t worker_id = 0; worker_id < utilisation.size(); ++worker_id)
+        std::cout << "Worker " << worker_id << ": " << 100. * utilisation[worker_id].busy_fraction() << " % busy, "
+                  << utilisation[worker_id].n_tasks << " tasks, " << utilisation[worker_id].n_steals << " steals"
+                  << std::endl;
+    if(params.analyze_heartbeat) {
+        const std::vector<analysis_data> analysis_results = analyzer.finish();
+        for(size_t roi_id = 0; roi_id < analysis_results.size(); ++roi_id) {
+            std::cout << "Heartbeat";
+            if(analysis_results.size() > 1)
+                std::cout << " of ROI " << roi_id;
+            std::cout << ": " << analysis_results[roi_id].heartbeat_number << " bpm" << std::endl;
+        }
+    }
+
+    FFTWPlanner::instance().save_wisdom(wisdom_filename);
+    return 0;
+}
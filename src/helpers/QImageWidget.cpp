@@ -3,21 +3,22 @@
 #include <QtWidgets/QLabel>
 #include <opencv2/imgproc.hpp>
 #include <QtGui/QImage>
+#include <QtGui/QPainter>
 #include <qevent.h>
 #include <helpers/common.h>
 #include <qcoreevent.h>
 #include <iostream>
+#include <algorithm>
 
 QImageWidget::QImageWidget(QWidget *parent, Qt::WindowFlags f) : QLabel(parent, f) {
     setMouseTracking(true);
-    QObject::connect(this, SIGNAL(new_frame(QPixmap)), SLOT(got_new_frame(QPixmap)));
+    setMinimumSize(1, 1); //The preview follows the widget size instead of the other way round
+    QObject::connect(this, SIGNAL(new_frame()), SLOT(got_new_frame()));
 }
 
 void QImageWidget::mousePressEvent(QMouseEvent* ev) {
-    selection.point_from.x = ev->x();
-    selection.point_from.y = ev->y();
-    selection.point_to.x = ev->x();
-    selection.point_to.y = ev->y();
+    selection.point_from = to_frame_coordinates(ev->pos());
+    selection.point_to = selection.point_from;
     selection.selecting = true;
     selection.complete = false;
     selection.fresh = true;
@@ -25,13 +26,13 @@ void QImageWidget::mousePressEvent(QMouseEvent* ev) {
 }
 
 void QImageWidget::mouseReleaseEvent(QMouseEvent* ev) {
-    if (selection.point_from.x == ev->x() && selection.point_from.y == ev->y()) {
+    const cv::Point2i point = to_frame_coordinates(ev->pos());
+    if (selection.point_from == point) {
         selection.selecting = false;
         selection.complete = false;
         selection.fresh = true;
     } else {
-        selection.point_to.x = ev->x();
-        selection.point_to.y = ev->y();
+        selection.point_to = point;
         selection.selecting = false;
         selection.complete = true;
         selection.fresh = true;
@@ -41,21 +42,116 @@ void QImageWidget::mouseReleaseEvent(QMouseEvent* ev) {
 
 void QImageWidget::mouseMoveEvent(QMouseEvent *ev) {
     if(!selection.selecting) return;
-    selection.point_to.x = ev->x();
-    selection.point_to.y = ev->y();
+    selection.point_to = to_frame_coordinates(ev->pos());
     selection.fresh = true;
     emit area_selected(selection);
 }
 
-void QImageWidget::imshow(const cv::Mat image) {
-    QPixmap pixmap = QPixmap::fromImage(QImage(image.ptr<uchar>(0), image.cols, image.rows, image.step, QImage::Format_RGB888));
-    emit new_frame(pixmap);
+void QImageWidget::resizeEvent(QResizeEvent* ev) {
+    QLabel::resizeEvent(ev);
+    std::lock_guard<std::mutex> lock(preview_mutex);
+    preview_size = cv::Size(ev->size().width(), ev->size().height());
+}
+
+//Wraps the displayed frame without copying it; the frame stays alive until the next one is picked up
+void QImageWidget::paintEvent(QPaintEvent* ev) {
+    if(displayed_frame.image.empty()) {
+        QLabel::paintEvent(ev);
+        return;
+    }
+    const cv::Mat& image = displayed_frame.image;
+    QPainter painter(this);
+    painter.drawImage(get_image_rect().topLeft(), QImage(image.ptr<uchar>(0), image.cols, image.rows,
+                                                         static_cast<int>(image.step), QImage::Format_RGB888));
+}
+
+//Prefers the full frame size, but any smaller size works as well
+QSize QImageWidget::sizeHint() const {
+    if(displayed_frame.image.empty())
+        return QLabel::sizeHint();
+    return QSize(displayed_frame.frame_size.width, displayed_frame.frame_size.height);
+}
+
+void QImageWidget::imshow(const cv::Mat& image, const cv::Rect& selection_rect, const cv::Scalar& selection_color) {
+    cv::Size target_size;
+    {
+        std::lock_guard<std::mutex> lock(preview_mutex);
+        target_size = preview_size;
+    }
+
+    //Fit into the widget while keeping the aspect ratio, but never scale up
+    double scale = 1.;
+    if(target_size.area() > 0)
+        scale = std::min(1., std::min(static_cast<double>(target_size.width) / image.cols,
+                                      static_cast<double>(target_size.height) / image.rows));
+    const cv::Size scaled_size(std::max(static_cast<int>(image.cols * scale), 1),
+                               std::max(static_cast<int>(image.rows * scale), 1));
+
+    preview_frame frame;
+    frame.frame_size = image.size();
+    if(scaled_size == image.size())
+        cv::cvtColor(image, frame.image, CV_BGR2RGB);
+    else {
+        cv::resize(image, frame.image, scaled_size, 0, 0, cv::INTER_AREA);
+        cv::cvtColor(frame.image, frame.image, CV_BGR2RGB);
+    }
+    if(selection_rect.area() > 0) {
+        const double scale_x = static_cast<double>(scaled_size.width) / image.cols;
+        const double scale_y = static_cast<double>(scaled_size.height) / image.rows;
+        cv::rectangle(frame.image,
+                      cv::Point(static_cast<int>(selection_rect.x * scale_x), static_cast<int>(selection_rect.y * scale_y)),
+                      cv::Point(static_cast<int>(selection_rect.br().x * scale_x), static_cast<int>(selection_rect.br().y * scale_y)),
+                      selection_color);
+    }
+
+    //Only notify the GUI thread if it has picked up the previous frame, otherwise that frame is just replaced
+    bool notify;
+    {
+        std::lock_guard<std::mutex> lock(preview_mutex);
+        notify = pending_frame.image.empty();
+        pending_frame = frame;
+    }
+    if(notify)
+        emit new_frame();
 }
 
 void QImageWidget::show_text(std::string text) {
+    {
+        std::lock_guard<std::mutex> lock(preview_mutex);
+        pending_frame = preview_frame();
+    }
+    displayed_frame = preview_frame();
     emit setText(QString::fromStdString(text));
+    update();
+}
+
+void QImageWidget::got_new_frame() {
+    const cv::Size previous_frame_size = displayed_frame.frame_size;
+    {
+        std::lock_guard<std::mutex> lock(preview_mutex);
+        std::swap(displayed_frame, pending_frame);
+        pending_frame = preview_frame();
+    }
+    if(displayed_frame.image.empty())
+        return;
+    if(displayed_frame.frame_size != previous_frame_size)
+        updateGeometry();
+    update();
+}
+
+//Origin and size of the displayed frame, which is centered within the widget
+QRect QImageWidget::get_image_rect() const {
+    const cv::Size image_size = displayed_frame.image.size();
+    return QRect((width() - image_size.width) / 2, (height() - image_size.height) / 2,
+                 image_size.width, image_size.height);
 }
 
-void QImageWidget::got_new_frame(QPixmap pixmap) {
-    this->setPixmap(pixmap);
+cv::Point2i QImageWidget::to_frame_coordinates(const QPoint& position) const {
+    if(displayed_frame.image.empty())
+        return cv::Point2i(position.x(), position.y());
+    const QRect image_rect = get_image_rect();
+    const int x = std::min(std::max(position.x() - image_rect.x(), 0), image_rect.width());
+    const int y = std::min(std::max(position.y() - image_rect.y(), 0), image_rect.height());
+    return cv::Point2i(x * displayed_frame.frame_size.width / std::max(image_rect.width(), 1),
+                       y * displayed_frame.frame_size.height / std::max(image_rect.height(), 1));
 }
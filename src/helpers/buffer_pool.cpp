@@ -0,0 +1,133 @@
+#include <helpers/buffer_pool.h>
+
+#include <new>
+
+BufferPool::BufferPool() : n_allocations(0), recycling(true) { }
+
+BufferPool::~BufferPool() {
+    for(auto& blocks : released_blocks)
+        free_blocks(blocks.second.blocks);
+}
+
+void BufferPool::free_blocks(const std::vector<cv::UMatData*>& blocks) {
+    for(cv::UMatData* block : blocks) {
+        cv::fastFree(block->origdata);
+        delete block;
+    }
+}
+
+cv::UMatData* BufferPool::allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                                   int /*flags*/, cv::UMatUsageFlags /*usage_flags*/) const {
+    size_t total = CV_ELEM_SIZE(type);
+    for(int i = dims-1; i >= 0; --i) {
+        if(step) {
+            if(data && step[i] != CV_AUTOSTEP) {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            } else
+                step[i] = total;
+        }
+        total *= sizes[i];
+    }
+
+    if(data) { //User provided memory, nothing to pool
+        cv::UMatData* u = new cv::UMatData(this);
+        u->data = u->origdata = static_cast<uchar*>(data);
+        u->size = total;
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+        return u;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++n_outstanding;
+        auto blocks = released_blocks.find(total);
+        if(blocks != released_blocks.end())
+            blocks->second.last_requested = generation;
+        if(blocks != released_blocks.end() && !blocks->second.blocks.empty()) {
+            //Reuse both the data and its UMatData, reset to the state of a fresh one
+            cv::UMatData* u = blocks->second.blocks.back();
+            blocks->second.blocks.pop_back();
+            uchar* block_data = u->origdata;
+            u->~UMatData();
+            new(u) cv::UMatData(this);
+            u->data = u->origdata = block_data;
+            u->size = total;
+            return u;
+        }
+    }
+    ++n_allocations;
+    cv::UMatData* u = new cv::UMatData(this);
+    u->data = u->origdata = static_cast<uchar*>(cv::fastMalloc(total));
+    u->size = total;
+    return u;
+}
+
+bool BufferPool::allocate(cv::UMatData* data, int /*access_flags*/, cv::UMatUsageFlags /*usage_flags*/) const {
+    return data != nullptr;
+}
+
+void BufferPool::deallocate(cv::UMatData* data) const {
+    if(!data)
+        return;
+    CV_Assert(data->urefcount == 0 && data->refcount == 0);
+    if(data->flags & cv::UMatData::USER_ALLOCATED) {
+        delete data;
+        return;
+    }
+
+    bool destroy_pool;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        --n_outstanding;
+        if(recycling && !released) //A new size counts as requested in the current generation
+            released_blocks.emplace(data->size, size_class{{}, generation}).first->second.blocks.push_back(data);
+        else {
+            cv::fastFree(data->origdata);
+            delete data;
+        }
+        destroy_pool = released && n_outstanding == 0;
+    }
+    if(destroy_pool)
+        delete this;
+}
+
+void BufferPool::set_recycling(const bool _recycling) noexcept {
+    recycling = _recycling;
+}
+
+size_t BufferPool::get_n_allocations() const noexcept {
+    return n_allocations;
+}
+
+void BufferPool::release_unused() {
+    std::vector<cv::UMatData*> unused;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto blocks = released_blocks.begin(); blocks != released_blocks.end(); ) {
+            if(generation - blocks->second.last_requested >= idle_generations) {
+                unused.insert(unused.end(), blocks->second.blocks.begin(), blocks->second.blocks.end());
+                blocks = released_blocks.erase(blocks);
+            } else
+                ++blocks;
+        }
+        ++generation;
+    }
+    free_blocks(unused);
+}
+
+void BufferPool::release() {
+    std::vector<cv::UMatData*> unused;
+    bool destroy_pool;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto& blocks : released_blocks)
+            unused.insert(unused.end(), blocks.second.blocks.begin(), blocks.second.blocks.end());
+        released_blocks.clear();
+        released = true;
+        destroy_pool = n_outstanding == 0;
+    }
+    free_blocks(unused);
+    if(destroy_pool)
+        delete this;
+}
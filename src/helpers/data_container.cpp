@@ -1,75 +1,147 @@
 #include <helpers/data_container.h>
+#include <helpers/sample_precision.h>
+#include <include/processing/frame_conversion.h>
+#include <cstring>
 #include <iostream>
 
-DataContainer::DataContainer(parameter_store& _params) noexcept : params(_params) {
+const int DataContainer::tile_width;
+const size_t DataContainer::mapped_block_bytes;
+
+DataContainer::DataContainer(parameter_store& _params) noexcept : buffer_pool(new BufferPool), params(_params) {
+    buffer_pool->set_recycling(params.pool_buffers);
     init_buffers();
 }
 
+DataContainer::~DataContainer() {
+    buffer_pool->release();
+}
+
 void DataContainer::push_frame(const cv::Mat_<cv::Vec3f>& frame, parameter_store& _params) {
     current_input_frame = frame;
     if(params.n_layers != _params.n_layers || params.n_buffered_frames != _params.n_buffered_frames ||
             params.roi_rect.width != _params.roi_rect.width || params.roi_rect.height != _params.roi_rect.height ||
-            params.spatial_filter != _params.spatial_filter || params.temporal_filter != _params.temporal_filter) {
+            params.n_channels != _params.n_channels || params.layer_channels != _params.layer_channels ||
+            params.spatial_filter != _params.spatial_filter || params.temporal_filter != _params.temporal_filter ||
+            params.ideal_filter_engine != _params.ideal_filter_engine ||
+            params.temporal_buffer_layout != _params.temporal_buffer_layout ||
+            params.temporal_buffer_precision != _params.temporal_buffer_precision ||
+            params.temporal_buffer_storage != _params.temporal_buffer_storage ||
+            params.temporal_buffer_directory != _params.temporal_buffer_directory ||
+            params.offline_filter != _params.offline_filter) {
         params = _params;
         if(params.spatial_filter != spatial_filter_type::NONE)
             init_buffers();
     }
-    params.analyze_heartbeat = _params.analyze_heartbeat;
+    params.pool_buffers = _params.pool_buffers;
+    buffer_pool->set_recycling(params.pool_buffers);
 }
 
-cv::Mat_<cv::Vec3f> DataContainer::pop_frame() noexcept {
+cv::Mat_<cv::Vec3f> DataContainer::pop_frame() {
     previous_input_frame = current_input_frame;
-    if(params.analyze_heartbeat) {
-        cv::Scalar_<float> mean_value = cv::mean(current_input_frame(params.roi_rect));
-        for(int i = 0; i < params.n_channels; ++i)
-            average_roi_pixels.at<float>(i, current_frame_id % params.n_buffered_frames) = mean_value[i];
-    }
-    ++current_frame_id;
+    advance_frame();
     return current_input_frame;
 }
 
+void DataContainer::advance_frame() {
+    ++current_frame_id;
+    buffer_pool->release_unused();
+}
+
 
-//Only the frame data within the current ROI
-const cv::Mat_<cv::Vec3f> DataContainer::get_frame_roi() {
-    cv::Mat roi_rect_data = current_input_frame(params.roi_rect).clone();
-    current_input_frame(params.roi_rect).setTo(0);
-    return roi_rect_data;
+//Only the layer channels of the frame data within the current ROI
+const cv::Mat DataContainer::get_frame_roi() {
+    return frame_conversion::take_layer_channels(current_input_frame(params.roi_rect), params.layer_channels,
+                                                 buffer_pool);
 }
 
 
 //Single layer input and output
-void DataContainer::put_layer(const int layer_id, const cv::Mat_<cv::Vec3f>& layer) {
-    if(params.temporal_filter == temporal_filter_type::IDEAL) {
+void DataContainer::put_layer(const int layer_id, const cv::Mat& layer) {
+    if(has_temporal_buffers()) {
         if(params.spatial_filter == spatial_filter_type::LAPLACIAN)
-            layer.reshape(1, static_cast<int>(layer.total()) * params.n_channels)
-                    .copyTo(original_temporal_buffer[layer_id].col(current_frame_id % params.n_buffered_frames));
+            put_timeseries_sample(layer_id, layer);
         else if(params.spatial_filter == spatial_filter_type::GAUSSIAN) {
             if(layer_id < params.n_layers-1)
                 current_layers[layer_id] = layer;
             else
-                layer.reshape(1, static_cast<int>(layer.total()) * params.n_channels)
-                        .copyTo(original_temporal_buffer[0].col(current_frame_id % params.n_buffered_frames));
+                put_timeseries_sample(0, layer);
         }
     }
     else
         current_layers[layer_id] = layer;
 }
 
-void DataContainer::insert_reconstructed_layer_roi(const cv::Mat_<cv::Vec3f>& roi) {
-    current_input_frame(params.roi_rect) += roi;
+void DataContainer::put_timeseries_sample(const int buffer_id, const cv::Mat& layer) {
+    cv::Mat_<float> timeseries_sample = layer.reshape(1, static_cast<int>(layer.total()) * params.n_channels);
+    const int position = current_frame_id % params.n_buffered_frames;
+    const bool sliding_dft = params.ideal_filter_engine == ideal_filter_engine_type::SLIDING_DFT;
+
+    if(has_compact_timeseries()) { //Narrow each sample; the delta is taken between stored values to avoid drift
+        const float* sample = timeseries_sample.ptr<float>(0);
+        int16_t* buffer = compact_temporal_buffer[buffer_id].ptr<int16_t>(0);
+        for(int row = 0; row < timeseries_sample.rows; ++row) {
+            int16_t& stored = buffer[get_sample_offset(row, position)];
+            const int16_t narrowed = encode_sample(sample[row], params.temporal_buffer_precision);
+            if(sliding_dft)
+                sample_delta[buffer_id](row, 0) = decode_sample(narrowed, params.temporal_buffer_precision) -
+                                                  decode_sample(stored, params.temporal_buffer_precision);
+            stored = narrowed;
+        }
+    } else if(params.temporal_buffer_layout == temporal_buffer_layout_type::PIXEL_MAJOR) {
+        cv::Mat_<float> buffer_column = original_temporal_buffer[buffer_id].col(position);
+        if(sliding_dft)
+            cv::subtract(timeseries_sample, buffer_column, sample_delta[buffer_id]);
+        timeseries_sample.copyTo(buffer_column);
+    } else { //TILED: One contiguous write of tile_width samples per tile
+        const float* sample = timeseries_sample.ptr<float>(0);
+        for(int row = 0; row < timeseries_sample.rows; row += tile_width) {
+            float* tile_row = original_temporal_buffer[buffer_id].ptr<float>(row / tile_width * params.n_buffered_frames + position);
+            const int n_lanes = std::min(tile_width, timeseries_sample.rows - row);
+            if(sliding_dft)
+                for(int lane = 0; lane < n_lanes; ++lane)
+                    sample_delta[buffer_id](row + lane, 0) = sample[row + lane] - tile_row[lane];
+            std::memcpy(tile_row, sample + row, n_lanes * sizeof(float));
+        }
+    }
+}
+
+//The current sample of all timeseries of a processed temporal buffer, reshaped to the layer
+cv::Mat DataContainer::get_timeseries_sample(const int buffer_id, const int layer_id) {
+    const int position = current_frame_id % params.n_buffered_frames;
+    const int layer_height = fit_to_layer(params.roi_rect.size(), layer_id).height;
+
+    cv::Mat_<float> timeseries_sample = buffer_pool->matrix<float>();
+    if(has_compact_timeseries()) { //Only the current output sample is kept
+        processed_temporal_buffer[buffer_id].copyTo(timeseries_sample);
+        return timeseries_sample.reshape(params.n_channels, layer_height);
+    }
+    if(params.temporal_buffer_layout == temporal_buffer_layout_type::PIXEL_MAJOR) {
+        processed_temporal_buffer[buffer_id].col(position).copyTo(timeseries_sample);
+        return timeseries_sample.reshape(params.n_channels, layer_height);
+    }
+
+    timeseries_sample.create(get_n_timeseries_rows(buffer_id), 1);
+    float* sample = timeseries_sample.ptr<float>(0);
+    for(int row = 0; row < timeseries_sample.rows; row += tile_width)
+        std::memcpy(sample + row,
+                    processed_temporal_buffer[buffer_id].ptr<float>(row / tile_width * params.n_buffered_frames + position),
+                    std::min(tile_width, timeseries_sample.rows - row) * sizeof(float));
+    return timeseries_sample.reshape(params.n_channels, layer_height);
+}
+
+void DataContainer::insert_reconstructed_layer_roi(const cv::Mat& roi) {
+    frame_conversion::add_layer_channels(roi, params.layer_channels, current_input_frame(params.roi_rect));
 }
 
-cv::Mat_<cv::Vec3f> DataContainer::get_layer(const int layer_id) noexcept {
-    if(params.temporal_filter == temporal_filter_type::IDEAL) {
+cv::Mat DataContainer::get_layer(const int layer_id) noexcept {
+    if(has_temporal_buffers()) {
         if(params.spatial_filter == spatial_filter_type::LAPLACIAN)
-            return processed_temporal_buffer[layer_id].col(current_frame_id % params.n_buffered_frames)
-                    .clone().reshape(params.n_channels, fit_to_layer(params.roi_rect.size(), layer_id).height);
+            return get_timeseries_sample(layer_id, layer_id);
         else if(params.spatial_filter == spatial_filter_type::GAUSSIAN) {
             if(layer_id < params.n_layers-1)
                return current_layers[layer_id];
             else
-                return processed_temporal_buffer[0].col(current_frame_id % params.n_buffered_frames)
-                        .clone().reshape(params.n_channels, fit_to_layer(params.roi_rect.size(), layer_id).height);
+                return get_timeseries_sample(0, layer_id);
         }
     }
     else
@@ -78,74 +150,288 @@ cv::Mat_<cv::Vec3f> DataContainer::get_layer(const int layer_id) noexcept {
 
 
 cv::Mat_<float> DataContainer::get_input_timeseries(const int layer_id, const int timeseries_id, const int channel_id) {
-    return original_temporal_buffer[layer_id].row(timeseries_id*params.n_channels+channel_id);
+    return get_timeseries(original_temporal_buffer[layer_id], timeseries_id*params.n_channels+channel_id);
 }
 
 cv::Mat_<float> DataContainer::get_output_timeseries(const int layer_id, const int timeseries_id, const int channel_id) {
-    return processed_temporal_buffer[layer_id].row(timeseries_id*params.n_channels+channel_id);
+    return get_timeseries(processed_temporal_buffer[layer_id], timeseries_id*params.n_channels+channel_id);
 }
 
-cv::Mat_<float> DataContainer::get_fftwf_data(const int layer_id, const int timeseries_id, const int channel_id) {
-    return fftwf_buffer[layer_id].row(timeseries_id*params.n_channels+channel_id);
+//PIXEL_MAJOR timeseries are contiguous rows, TILED timeseries are columns with a stride of tile_width
+cv::Mat_<float> DataContainer::get_timeseries(cv::Mat_<float>& buffer, const int row) {
+    if(params.temporal_buffer_layout == temporal_buffer_layout_type::PIXEL_MAJOR)
+        return buffer.row(row);
+    return cv::Mat_<float>(params.n_buffered_frames, 1,
+                           buffer.ptr<float>(row / tile_width * params.n_buffered_frames) + row % tile_width,
+                           tile_width * sizeof(float));
 }
 
-cv::Mat_<cv::Vec3f> DataContainer::get_lowpassLo(const int layer_id) {
+int DataContainer::get_timeseries_stride() const noexcept {
+    //Compact timeseries are handed to the filter as contiguous widened copies
+    if(has_compact_timeseries() || params.temporal_buffer_layout == temporal_buffer_layout_type::PIXEL_MAJOR)
+        return 1;
+    return tile_width;
+}
+
+int DataContainer::get_timeseries_batch_size() const noexcept {
+    return tile_width;
+}
+
+int DataContainer::get_timeseries_dist() const noexcept {
+    if(has_compact_timeseries() || params.temporal_buffer_layout == temporal_buffer_layout_type::PIXEL_MAJOR)
+        return params.n_buffered_frames;
+    return 1;
+}
+
+bool DataContainer::has_compact_timeseries() const noexcept {
+    return params.temporal_buffer_precision != temporal_buffer_precision_type::FLOAT;
+}
+
+void DataContainer::widen_input_timeseries(const int layer_id, const int timeseries_id, const int channel_id,
+                                           float* timeseries) {
+    const int row = timeseries_id*params.n_channels+channel_id;
+    const size_t offset = get_sample_offset(row, 0);
+    const size_t stride = params.temporal_buffer_layout == temporal_buffer_layout_type::PIXEL_MAJOR ? 1 : tile_width;
+    if(has_compact_timeseries()) {
+        const int16_t* samples = compact_temporal_buffer[layer_id].ptr<int16_t>(0) + offset;
+        for(int position = 0; position < params.n_buffered_frames; ++position)
+            timeseries[position] = decode_sample(samples[position * stride], params.temporal_buffer_precision);
+    } else {
+        const float* samples = original_temporal_buffer[layer_id].ptr<float>(0) + offset;
+        for(int position = 0; position < params.n_buffered_frames; ++position)
+            timeseries[position] = samples[position * stride];
+    }
+}
+
+void DataContainer::replace_input_timeseries(const int layer_id, const int timeseries_id, const int channel_id,
+                                             const float* timeseries) {
+    const int row = timeseries_id*params.n_channels+channel_id;
+    const size_t offset = get_sample_offset(row, 0);
+    const size_t stride = params.temporal_buffer_layout == temporal_buffer_layout_type::PIXEL_MAJOR ? 1 : tile_width;
+    if(has_compact_timeseries()) {
+        int16_t* samples = compact_temporal_buffer[layer_id].ptr<int16_t>(0) + offset;
+        for(int position = 0; position < params.n_buffered_frames; ++position)
+            samples[position * stride] = encode_sample(timeseries[position], params.temporal_buffer_precision);
+    } else {
+        float* samples = original_temporal_buffer[layer_id].ptr<float>(0) + offset;
+        for(int position = 0; position < params.n_buffered_frames; ++position)
+            samples[position * stride] = timeseries[position];
+    }
+}
+
+cv::Mat DataContainer::get_buffered_layer(const int layer_id, const int frame_id) {
+    if(!has_temporal_buffers() || params.spatial_filter == spatial_filter_type::NONE ||
+            (params.spatial_filter == spatial_filter_type::GAUSSIAN && layer_id < params.n_layers-1))
+        return cv::Mat();
+
+    const int buffer_id = params.spatial_filter == spatial_filter_type::LAPLACIAN ? layer_id : 0;
+    const int position = frame_id % params.n_buffered_frames;
+    cv::Mat_<float> layer_sample(get_n_timeseries_rows(buffer_id), 1);
+    for(int row = 0; row < layer_sample.rows; ++row) {
+        const size_t offset = get_sample_offset(row, position);
+        layer_sample(row, 0) = has_compact_timeseries() ?
+                decode_sample(compact_temporal_buffer[buffer_id].ptr<int16_t>(0)[offset], params.temporal_buffer_precision) :
+                original_temporal_buffer[buffer_id].ptr<float>(0)[offset];
+    }
+    return layer_sample.reshape(params.n_channels, fit_to_layer(params.roi_rect.size(), layer_id).height);
+}
+
+float DataContainer::get_current_input_sample(const int layer_id, const int timeseries_id, const int channel_id) {
+    const size_t offset = get_sample_offset(timeseries_id*params.n_channels+channel_id,
+                                            current_frame_id % params.n_buffered_frames);
+    if(has_compact_timeseries())
+        return decode_sample(compact_temporal_buffer[layer_id].ptr<int16_t>(0)[offset], params.temporal_buffer_precision);
+    return original_temporal_buffer[layer_id].ptr<float>(0)[offset];
+}
+
+void DataContainer::put_current_output_sample(const int layer_id, const int timeseries_id, const int channel_id,
+                                              const float sample) {
+    const int row = timeseries_id*params.n_channels+channel_id;
+    if(has_compact_timeseries())
+        processed_temporal_buffer[layer_id](row, 0) = sample;
+    else
+        processed_temporal_buffer[layer_id].ptr<float>(0)[get_sample_offset(row, current_frame_id % params.n_buffered_frames)] = sample;
+}
+
+void DataContainer::repeat_output_sample(const int layer_id, const int timeseries_id, const int channel_id) {
+    if(current_frame_id == 0) {
+        put_current_output_sample(layer_id, timeseries_id, channel_id,
+                                  get_current_input_sample(layer_id, timeseries_id, channel_id));
+        return;
+    }
+    if(has_compact_timeseries()) //The kept sample still is the previous one
+        return;
+    const int row = timeseries_id*params.n_channels+channel_id;
+    float* samples = processed_temporal_buffer[layer_id].ptr<float>(0);
+    samples[get_sample_offset(row, current_frame_id % params.n_buffered_frames)] =
+            samples[get_sample_offset(row, (current_frame_id - 1) % params.n_buffered_frames)];
+}
+
+int DataContainer::get_timeseries_block_size(const int layer_id) const noexcept {
+    const int n_timeseries = get_n_timeseries_rows(layer_id) / params.n_channels;
+    if(params.temporal_buffer_storage == temporal_buffer_storage_type::MEMORY)
+        return n_timeseries;
+    const size_t sample_bytes = has_compact_timeseries() ? sizeof(int16_t) : sizeof(float);
+    const size_t timeseries_bytes = sample_bytes * params.n_channels * params.n_buffered_frames;
+    //Whole tiles per block, so that blocks never share a tile
+    const int block_size = std::max(1, static_cast<int>(mapped_block_bytes / timeseries_bytes) / tile_width) * tile_width;
+    return std::min(block_size, n_timeseries);
+}
+
+void DataContainer::prefetch_timeseries(const int layer_id, const int first_timeseries, const int n_timeseries) {
+    if(params.temporal_buffer_storage == temporal_buffer_storage_type::MAPPED_FILE)
+        advise_timeseries(layer_id, first_timeseries, n_timeseries, true);
+}
+
+void DataContainer::write_back_timeseries(const int layer_id, const int first_timeseries, const int n_timeseries) {
+    if(params.temporal_buffer_storage == temporal_buffer_storage_type::MAPPED_FILE)
+        advise_timeseries(layer_id, first_timeseries, n_timeseries, false);
+}
+
+//Prefetches or writes back the byte ranges of all mapped temporal buffers that hold the given timeseries
+void DataContainer::advise_timeseries(const int layer_id, const int first_timeseries, const int n_timeseries,
+                                      const bool prefetch) {
+    const int first_row = first_timeseries * params.n_channels;
+    const int end_row = std::min(get_n_timeseries_rows(layer_id), (first_timeseries + n_timeseries) * params.n_channels);
+    if(first_row >= end_row)
+        return;
+
+    auto advise = [prefetch](cv::Mat& buffer, const size_t begin, const size_t end) {
+        if(buffer.empty())
+            return;
+        uchar* data = buffer.ptr<uchar>(0) + begin * buffer.elemSize();
+        if(prefetch)
+            MappedFileAllocator::prefetch(data, (end - begin) * buffer.elemSize());
+        else
+            MappedFileAllocator::write_back(data, (end - begin) * buffer.elemSize());
+    };
+    const size_t history_begin = get_sample_offset(first_row, 0);
+    const size_t history_end = get_sample_offset(end_row - 1, params.n_buffered_frames - 1) + 1;
+    if(has_compact_timeseries()) //Only the current output sample is kept, in RAM
+        advise(compact_temporal_buffer[layer_id], history_begin, history_end);
+    else {
+        advise(original_temporal_buffer[layer_id], history_begin, history_end);
+        advise(processed_temporal_buffer[layer_id], history_begin, history_end);
+    }
+}
+
+//Zero-initialised temporal buffer, in RAM or in a memory-mapped file depending on the storage parameter
+template<typename T>
+cv::Mat_<T> DataContainer::allocate_temporal_buffer(const int rows, const int cols) {
+    if(params.temporal_buffer_storage == temporal_buffer_storage_type::MEMORY)
+        return cv::Mat_<T>::zeros(rows, cols);
+    cv::Mat_<T> buffer;
+    buffer.allocator = &mapped_allocator;
+    buffer.create(rows, cols); //Fresh mappings are zero-filled, no need to touch every page
+    return buffer;
+}
+
+//Element offset of a timeseries sample within a (continuous) temporal buffer of the current layout
+size_t DataContainer::get_sample_offset(const int row, const int position) const noexcept {
+    if(params.temporal_buffer_layout == temporal_buffer_layout_type::PIXEL_MAJOR)
+        return static_cast<size_t>(row) * params.n_buffered_frames + position;
+    return (static_cast<size_t>(row / tile_width) * params.n_buffered_frames + position) * tile_width + row % tile_width;
+}
+
+float DataContainer::get_sample_delta(const int layer_id, const int timeseries_id, const int channel_id) {
+    return sample_delta[layer_id](timeseries_id*params.n_channels+channel_id, 0);
+}
+
+cv::Mat_<double> DataContainer::get_sliding_dft_bins(const int layer_id, const int timeseries_id, const int channel_id) {
+    return sliding_dft_bins[layer_id].row(timeseries_id*params.n_channels+channel_id);
+}
+
+//(Re-)allocates the bins if the passband changed; returns true if they have to be recalculated from the buffer
+bool DataContainer::update_sliding_dft_band(const cv::Range& band) {
+    if(band == sliding_dft_band && sliding_dft_bins.size() == processed_temporal_buffer.size())
+        return false;
+    sliding_dft_band = band;
+    sliding_dft_bins = std::vector<cv::Mat_<double>>(processed_temporal_buffer.size());
+    for(size_t buffer_id = 0; buffer_id < processed_temporal_buffer.size(); ++buffer_id)
+        sliding_dft_bins[buffer_id] = cv::Mat_<double>::zeros(get_n_timeseries_rows(static_cast<int>(buffer_id)),
+                                                              2 * std::max(band.size(), 0));
+    return true;
+}
+
+cv::Mat DataContainer::get_lowpassLo(const int layer_id) {
     return lowpassLo[layer_id];
 }
 
-cv::Mat_<cv::Vec3f> DataContainer::get_lowpassHi(const int layer_id) {
+cv::Mat DataContainer::get_lowpassHi(const int layer_id) {
     return lowpassHi[layer_id];
 }
 
-cv::Mat_<float> DataContainer::get_average_roi_pixels() {
-    return average_roi_pixels;
+riesz_layer_state& DataContainer::get_riesz_state(const int layer_id) {
+    return riesz_states[layer_id];
 }
 
 const int DataContainer::get_n_used_frames() {
     return current_frame_id+1;
 }
 
+BufferPool& DataContainer::get_buffer_pool() noexcept {
+    return *buffer_pool;
+}
+
 void DataContainer::init_buffers() {
     current_frame_id = 0;
-    if(params.temporal_filter == temporal_filter_type::IDEAL) {
-        if(params.spatial_filter == spatial_filter_type::LAPLACIAN) {
-            original_temporal_buffer = std::vector<cv::Mat_<float>>(params.n_layers);
-            processed_temporal_buffer = std::vector<cv::Mat_<float>>(params.n_layers);
-            fftwf_buffer = std::vector<cv::Mat_<float>>(params.n_layers);
-            for (int layer_id = 0; layer_id < params.n_layers; ++layer_id) {
-                original_temporal_buffer[layer_id] = cv::Mat_<float>::zeros(
-                        fit_to_layer(params.roi_rect.size(), layer_id).area() * params.n_channels,
-                        params.n_buffered_frames);
-                processed_temporal_buffer[layer_id] = cv::Mat_<float>(
-                        fit_to_layer(params.roi_rect.size(), layer_id).area() * params.n_channels,
-                        params.n_buffered_frames);
-                fftwf_buffer[layer_id] = cv::Mat_<float>(
-                        fit_to_layer(params.roi_rect.size(), layer_id).area() * params.n_channels,
-                        params.n_buffered_frames + 2);
-            }
-        } else if(params.spatial_filter == spatial_filter_type::GAUSSIAN) {
-            original_temporal_buffer = std::vector<cv::Mat_<float>>(1);
-            processed_temporal_buffer = std::vector<cv::Mat_<float>>(1);
-            fftwf_buffer = std::vector<cv::Mat_<float>>(1);
+    if(has_temporal_buffers()) {
+        mapped_allocator.set_directory(params.temporal_buffer_directory);
+        const int n_buffers = params.spatial_filter == spatial_filter_type::LAPLACIAN ? params.n_layers : 1;
+        if(params.spatial_filter == spatial_filter_type::GAUSSIAN)
             current_layers.resize(params.n_layers - 1);
-            original_temporal_buffer[0] = cv::Mat_<float>::zeros(
-                    fit_to_layer(params.roi_rect.size(), params.n_layers-1).area() * params.n_channels,
-                    params.n_buffered_frames);
-            processed_temporal_buffer[0] = cv::Mat_<float>::zeros(
-                    fit_to_layer(params.roi_rect.size(), params.n_layers-1).area() * params.n_channels,
-                    params.n_buffered_frames);
-            fftwf_buffer[0] = cv::Mat_<float>::zeros(
-                    fit_to_layer(params.roi_rect.size(), params.n_layers-1).area() * params.n_channels,
-                    params.n_buffered_frames + 2);
+        original_temporal_buffer = std::vector<cv::Mat_<float>>(n_buffers);
+        processed_temporal_buffer = std::vector<cv::Mat_<float>>(n_buffers);
+        compact_temporal_buffer = std::vector<cv::Mat_<short>>(n_buffers);
+        sample_delta = std::vector<cv::Mat_<float>>(n_buffers);
+        sliding_dft_bins.clear();
+        for (int buffer_id = 0; buffer_id < n_buffers; ++buffer_id) {
+            const int n_rows = get_n_timeseries_rows(buffer_id);
+            if(has_compact_timeseries()) { //A zero bit pattern is 0.f for both HALF and INT16
+                const int n_tiles = (n_rows + tile_width - 1) / tile_width;
+                if(params.temporal_buffer_layout == temporal_buffer_layout_type::PIXEL_MAJOR)
+                    compact_temporal_buffer[buffer_id] = allocate_temporal_buffer<short>(n_rows, params.n_buffered_frames);
+                else
+                    compact_temporal_buffer[buffer_id] = allocate_temporal_buffer<short>(n_tiles * params.n_buffered_frames,
+                                                                                         tile_width);
+                if(!params.offline_filter)
+                    processed_temporal_buffer[buffer_id] = cv::Mat_<float>::zeros(n_rows, 1);
+            } else if(params.temporal_buffer_layout == temporal_buffer_layout_type::PIXEL_MAJOR) {
+                original_temporal_buffer[buffer_id] = allocate_temporal_buffer<float>(n_rows, params.n_buffered_frames);
+                if(!params.offline_filter) //Offline, the filtered timeseries replace the input history
+                    processed_temporal_buffer[buffer_id] = allocate_temporal_buffer<float>(n_rows, params.n_buffered_frames);
+            } else { //TILED: For each tile of tile_width timeseries, one row of tile_width samples per frame
+                const int n_tiles = (n_rows + tile_width - 1) / tile_width;
+                original_temporal_buffer[buffer_id] = allocate_temporal_buffer<float>(n_tiles * params.n_buffered_frames,
+                                                                                      tile_width);
+                if(!params.offline_filter)
+                    processed_temporal_buffer[buffer_id] = allocate_temporal_buffer<float>(n_tiles * params.n_buffered_frames,
+                                                                                           tile_width);
+            }
+            if(params.ideal_filter_engine == ideal_filter_engine_type::SLIDING_DFT && !params.offline_filter)
+                sample_delta[buffer_id] = cv::Mat_<float>::zeros(n_rows, 1);
         }
+    } else if(params.spatial_filter == spatial_filter_type::RIESZ) {
+        current_layers.resize(params.n_layers);
+        riesz_states = std::vector<riesz_layer_state>(params.n_layers);
     } else {
         current_layers.resize(params.n_layers);
         lowpassLo.resize(params.n_layers);
         lowpassHi.resize(params.n_layers);
         for (int layer_id = 0; layer_id < params.n_layers; ++layer_id) {
-            lowpassLo[layer_id] = cv::Mat_<cv::Vec3f>::zeros(fit_to_layer(params.roi_rect.size(), layer_id));
-            lowpassHi[layer_id] = cv::Mat_<cv::Vec3f>::zeros(fit_to_layer(params.roi_rect.size(), layer_id));
+            lowpassLo[layer_id] = cv::Mat::zeros(fit_to_layer(params.roi_rect.size(), layer_id), CV_32FC(params.n_channels));
+            lowpassHi[layer_id] = cv::Mat::zeros(fit_to_layer(params.roi_rect.size(), layer_id), CV_32FC(params.n_channels));
         }
     }
-    average_roi_pixels = cv::Mat_<float>::zeros(params.n_channels, params.n_buffered_frames);
+}
+
+//Only the ideal filter keeps a history of layers; phase-based magnification always filters with IIR lowpasses
+bool DataContainer::has_temporal_buffers() const noexcept {
+    return params.temporal_filter == temporal_filter_type::IDEAL && params.spatial_filter != spatial_filter_type::RIESZ;
+}
+
+//Number of timeseries (pixels times channels) stored in a temporal buffer for ideal filtering
+int DataContainer::get_n_timeseries_rows(const int buffer_id) const noexcept {
+    const int layer_id = params.spatial_filter == spatial_filter_type::LAPLACIAN ? buffer_id : params.n_layers-1;
+    return fit_to_layer(params.roi_rect.size(), layer_id).area() * params.n_channels;
 }
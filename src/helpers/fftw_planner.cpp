@@ -0,0 +1,232 @@
+#include <helpers/fftw_planner.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+//Time without new requests before the background thread starts measuring, so that the caller can first get estimates
+//for all plans it needs without waiting for the planner
+static const std::chrono::milliseconds settle_time(100);
+
+FFTWPlanner& FFTWPlanner::instance() {
+    static FFTWPlanner planner;
+    return planner;
+}
+
+FFTWPlanner::FFTWPlanner() { }
+
+//Waits for the measurement in progress, the remaining ones are dropped
+FFTWPlanner::~FFTWPlanner() {
+    {
+        std::lock_guard<std::mutex> lock(plans_mutex);
+        shutdown = true;
+        pending.clear();
+        pending_estimates.clear();
+    }
+    pending_changed.notify_all();
+    if(planning_thread.joinable())
+        planning_thread.join();
+
+    std::lock_guard<std::mutex> planner_lock(planner_mutex);
+    destroy_retired();
+    for(auto& plan : estimated_plans)
+        fftwf_destroy_plan(plan.second.plan);
+    for(auto& plan : measured_plans)
+        fftwf_destroy_plan(plan.second.plan);
+}
+
+bool FFTWPlanner::load_wisdom(const std::string& filename) {
+    std::lock_guard<std::mutex> planner_lock(planner_mutex);
+    return !filename.empty() && fftwf_import_wisdom_from_filename(filename.c_str()) != 0;
+}
+
+bool FFTWPlanner::save_wisdom(const std::string& filename) {
+    std::lock_guard<std::mutex> planner_lock(planner_mutex);
+    return !filename.empty() && fftwf_export_wisdom_to_filename(filename.c_str()) != 0;
+}
+
+std::string FFTWPlanner::default_wisdom_filename() {
+    const char* cache_home = std::getenv("XDG_CACHE_HOME");
+    if(cache_home && *cache_home)
+        return std::string(cache_home) + "/videomagnification.fftwf_wisdom";
+    const char* home = std::getenv("HOME");
+    if(home && *home)
+        return std::string(home) + "/.cache/videomagnification.fftwf_wisdom";
+    return "";
+}
+
+fftwf_plan FFTWPlanner::get(const fftw_plan_key& key) {
+    std::unique_lock<std::mutex> lock(plans_mutex);
+    auto measured = measured_plans.find(key);
+    if(measured != measured_plans.end())
+        return use(measured->second);
+    auto estimated = estimated_plans.find(key);
+    if(estimated != estimated_plans.end()) {
+        queue_measurement(key);
+        return use(estimated->second);
+    }
+    lock.unlock();
+
+    //New keys are planned on the caller's thread, from wisdom if it knows them, and only then queued for measurement.
+    //A measurement in progress holds the planner for long, the estimate is then planned right after it.
+    fftwf_plan plan = nullptr;
+    bool wisdom = false;
+    {
+        std::unique_lock<std::mutex> planner_lock(planner_mutex, std::try_to_lock);
+        if(planner_lock.owns_lock()) {
+            destroy_retired();
+            plan = create(key, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+            wisdom = plan != nullptr;
+            if(!wisdom)
+                plan = create(key, FFTW_ESTIMATE);
+        }
+    }
+    lock.lock();
+    if(wisdom)
+        return insert(measured_plans, key, plan);
+    if(plan) {
+        plan = insert(estimated_plans, key, plan);
+        queue_measurement(key);
+        return plan;
+    }
+    if(std::find(pending_estimates.begin(), pending_estimates.end(), key) == pending_estimates.end()) {
+        pending_estimates.push_back(key);
+        start_planning_thread();
+        pending_changed.notify_one();
+    }
+    return nullptr;
+}
+
+fftwf_plan FFTWPlanner::get_measured(const fftw_plan_key& key) {
+    std::unique_lock<std::mutex> lock(plans_mutex);
+    auto measured = measured_plans.find(key);
+    if(measured != measured_plans.end())
+        return use(measured->second);
+    lock.unlock();
+
+    fftwf_plan plan;
+    {
+        std::lock_guard<std::mutex> planner_lock(planner_mutex);
+        plan = create(key, FFTW_MEASURE);
+    }
+    lock.lock();
+    return insert(measured_plans, key, plan);
+}
+
+void FFTWPlanner::release_unused() {
+    {
+        std::lock_guard<std::mutex> lock(plans_mutex);
+        retire_unused(estimated_plans);
+        retire_unused(measured_plans);
+        //Measurements are only queued along with an estimate, so those without one are no longer needed
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [this](const fftw_plan_key& key) {
+            return estimated_plans.find(key) == estimated_plans.end();
+        }), pending.end());
+        ++generation;
+    }
+    std::unique_lock<std::mutex> planner_lock(planner_mutex, std::try_to_lock);
+    if(planner_lock.owns_lock())
+        destroy_retired();
+}
+
+//Stores plan unless another thread planned the same key meanwhile, in which case plan is retired; the caller holds
+//plans_mutex
+fftwf_plan FFTWPlanner::insert(std::map<fftw_plan_key, cached_plan>& plans, const fftw_plan_key& key,
+                               fftwf_plan plan) {
+    auto inserted = plans.emplace(key, cached_plan{plan, generation});
+    if(!inserted.second)
+        retired_plans.push_back(plan);
+    return use(inserted.first->second);
+}
+
+//The caller holds plans_mutex
+fftwf_plan FFTWPlanner::use(cached_plan& plan) noexcept {
+    plan.last_used = generation;
+    return plan.plan;
+}
+
+//Moves the plans not requested in the current generation to the retired ones; the caller holds plans_mutex
+void FFTWPlanner::retire_unused(std::map<fftw_plan_key, cached_plan>& plans) {
+    for(auto plan = plans.begin(); plan != plans.end(); ) {
+        if(plan->second.last_used != generation) {
+            retired_plans.push_back(plan->second.plan);
+            plan = plans.erase(plan);
+        } else
+            ++plan;
+    }
+}
+
+//The caller holds planner_mutex, but not plans_mutex
+void FFTWPlanner::destroy_retired() {
+    std::vector<fftwf_plan> plans;
+    {
+        std::lock_guard<std::mutex> lock(plans_mutex);
+        plans.swap(retired_plans);
+    }
+    for(fftwf_plan plan : plans)
+        fftwf_destroy_plan(plan);
+}
+
+//Queues the measurement of an estimated plan unless it is queued already; the caller holds plans_mutex
+void FFTWPlanner::queue_measurement(const fftw_plan_key& key) {
+    if(std::find(pending.begin(), pending.end(), key) != pending.end())
+        return;
+    pending.push_back(key);
+    start_planning_thread();
+    pending_changed.notify_one();
+}
+
+//The caller holds plans_mutex
+void FFTWPlanner::start_planning_thread() {
+    if(!planning_thread.joinable())
+        planning_thread = std::thread(&FFTWPlanner::plan_pending, this);
+}
+
+//Plans on scratch arrays, as FFTW_MEASURE overwrites them; the caller holds planner_mutex
+fftwf_plan FFTWPlanner::create(const fftw_plan_key& key, const unsigned flags) {
+    const int n_bins = key.n / 2 + 1;
+    float* real_data = fftwf_alloc_real(static_cast<size_t>(key.n - 1) * key.stride +
+                                        static_cast<size_t>(key.howmany - 1) * key.dist + 1);
+    fftwf_complex* complex_data = fftwf_alloc_complex(static_cast<size_t>(key.howmany) * n_bins);
+    int n = key.n;
+    fftwf_plan plan;
+    if(key.forward)
+        plan = fftwf_plan_many_dft_r2c(1, &n, key.howmany, real_data, nullptr, key.stride, key.dist,
+                                       complex_data, nullptr, 1, n_bins, flags | FFTW_UNALIGNED);
+    else
+        plan = fftwf_plan_many_dft_c2r(1, &n, key.howmany, complex_data, nullptr, 1, n_bins,
+                                       real_data, nullptr, key.stride, key.dist, flags | FFTW_UNALIGNED);
+    fftwf_free(real_data);
+    fftwf_free(complex_data);
+    return plan;
+}
+
+//Background thread: Plans the estimates requested while the planner was busy, then measures one queued plan at a
+//time, so that estimates requested meanwhile wait for one measurement at most
+void FFTWPlanner::plan_pending() {
+    std::unique_lock<std::mutex> lock(plans_mutex);
+    while(true) {
+        pending_changed.wait(lock, [this] { return shutdown || !pending.empty() || !pending_estimates.empty(); });
+        while(!shutdown && pending_estimates.empty() &&
+              pending_changed.wait_for(lock, settle_time) == std::cv_status::no_timeout) { }
+        if(shutdown)
+            return;
+        const bool estimate = !pending_estimates.empty();
+        if(!estimate && pending.empty()) //Dropped by release_unused() meanwhile
+            continue;
+        const fftw_plan_key key = estimate ? pending_estimates.front() : pending.front();
+        lock.unlock();
+
+        fftwf_plan plan;
+        {
+            std::lock_guard<std::mutex> planner_lock(planner_mutex);
+            destroy_retired();
+            plan = create(key, estimate ? FFTW_ESTIMATE : FFTW_MEASURE);
+        }
+
+        lock.lock();
+        std::deque<fftw_plan_key>& queue = estimate ? pending_estimates : pending;
+        queue.erase(std::remove(queue.begin(), queue.end(), key), queue.end());
+        insert(estimate ? estimated_plans : measured_plans, key, plan);
+    }
+}
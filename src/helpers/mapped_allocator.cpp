@@ -0,0 +1,136 @@
+#include <helpers/mapped_allocator.h>
+
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+//$XDG_CACHE_HOME or ~/.cache, created if missing; $TMPDIR or /tmp only if neither is set, as these are RAM-backed
+//tmpfs on many systems, where the mapped buffers would stay resident
+static std::string get_default_directory() {
+    std::string directory;
+    const char* cache_home = std::getenv("XDG_CACHE_HOME");
+    const char* home = std::getenv("HOME");
+    if(cache_home && *cache_home)
+        directory = cache_home;
+    else if(home && *home)
+        directory = std::string(home) + "/.cache";
+    else {
+        const char* tmpdir = std::getenv("TMPDIR");
+        return tmpdir ? tmpdir : "/tmp";
+    }
+    mkdir(directory.c_str(), 0700); //Usually exists already
+    return directory;
+}
+
+//Warns once per directory if it is a tmpfs
+static void check_file_system(const std::string& directory) {
+#ifdef __linux__
+    static const long tmpfs_magic = 0x01021994;
+    static std::mutex checked_mutex;
+    static std::string checked_directory;
+    std::lock_guard<std::mutex> lock(checked_mutex);
+    if(directory == checked_directory)
+        return;
+    checked_directory = directory;
+    struct statfs file_system;
+    if(statfs(directory.c_str(), &file_system) == 0 && static_cast<long>(file_system.f_type) == tmpfs_magic)
+        std::cerr << "Warning: " << directory << " is a tmpfs, temporal buffers mapped there are kept in RAM"
+                  << std::endl;
+#else
+    (void)directory;
+#endif
+}
+
+void MappedFileAllocator::set_directory(const std::string& _directory) {
+    directory = _directory.empty() ? get_default_directory() : _directory;
+    check_file_system(directory);
+}
+
+cv::UMatData* MappedFileAllocator::allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                                            int /*flags*/, cv::UMatUsageFlags /*usage_flags*/) const {
+    size_t total = CV_ELEM_SIZE(type);
+    for(int i = dims-1; i >= 0; --i) {
+        if(step) {
+            if(data && step[i] != CV_AUTOSTEP) {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            } else
+                step[i] = total;
+        }
+        total *= sizes[i];
+    }
+
+    cv::UMatData* u = new cv::UMatData(this);
+    u->size = total;
+    if(data) { //User provided memory, nothing to map
+        u->data = u->origdata = static_cast<uchar*>(data);
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+        return u;
+    }
+
+    //The file is unlinked right away, it lives exactly as long as its mapping
+    std::string path = directory + "/vmag-temporal-buffer-XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if(fd < 0) {
+        delete u;
+        CV_Error(cv::Error::StsNoMem, "Could not create a temporal buffer file in " + directory);
+    }
+    unlink(path.c_str());
+    void* mapping = MAP_FAILED;
+    if(ftruncate(fd, static_cast<off_t>(total)) == 0)
+        mapping = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) {
+        delete u;
+        CV_Error(cv::Error::StsNoMem, "Could not map a temporal buffer file in " + directory);
+    }
+    u->data = u->origdata = static_cast<uchar*>(mapping);
+    return u;
+}
+
+bool MappedFileAllocator::allocate(cv::UMatData* data, int /*access_flags*/, cv::UMatUsageFlags /*usage_flags*/) const {
+    return data != nullptr;
+}
+
+void MappedFileAllocator::deallocate(cv::UMatData* data) const {
+    if(!data)
+        return;
+    CV_Assert(data->urefcount == 0 && data->refcount == 0);
+    if(!(data->flags & cv::UMatData::USER_ALLOCATED)) {
+        munmap(data->origdata, data->size);
+        data->origdata = nullptr;
+    }
+    delete data;
+}
+
+//madvise and msync work on whole pages; the range is widened to the pages it touches
+inline void page_range(const void* begin, const size_t n_bytes, void*& page_begin, size_t& page_bytes) noexcept {
+    const uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t first = reinterpret_cast<uintptr_t>(begin) & ~(page_size - 1);
+    const uintptr_t last = (reinterpret_cast<uintptr_t>(begin) + n_bytes + page_size - 1) & ~(page_size - 1);
+    page_begin = reinterpret_cast<void*>(first);
+    page_bytes = last - first;
+}
+
+void MappedFileAllocator::prefetch(const void* begin, const size_t n_bytes) noexcept {
+    void* page_begin;
+    size_t page_bytes;
+    page_range(begin, n_bytes, page_begin, page_bytes);
+    madvise(page_begin, page_bytes, MADV_WILLNEED);
+}
+
+void MappedFileAllocator::write_back(void* begin, const size_t n_bytes) noexcept {
+    void* page_begin;
+    size_t page_bytes;
+    page_range(begin, n_bytes, page_begin, page_bytes);
+    msync(page_begin, page_bytes, MS_ASYNC);
+    madvise(page_begin, page_bytes, MADV_DONTNEED); //Shared file pages stay in the file, only the RSS shrinks
+}
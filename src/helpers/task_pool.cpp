@@ -0,0 +1,162 @@
+#include <helpers/task_pool.h>
+
+#include <algorithm>
+
+TaskPool& TaskPool::instance() {
+    static TaskPool pool;
+    return pool;
+}
+
+//The threads that call parallel_for take part in the work, so one core is left to them
+TaskPool::TaskPool()
+        : n_workers(std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0)),
+          workers(new worker_state[n_workers]), statistics_start(std::chrono::steady_clock::now()) {
+    for(int worker_id = 0; worker_id < n_workers; ++worker_id) {
+        workers[worker_id].busy_nanoseconds = 0;
+        workers[worker_id].n_tasks = 0;
+        workers[worker_id].n_steals = 0;
+        workers[worker_id].thread = std::thread(&TaskPool::work, this, worker_id);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shutdown = true;
+    }
+    jobs_changed.notify_all();
+    for(int worker_id = 0; worker_id < n_workers; ++worker_id)
+        workers[worker_id].thread.join();
+}
+
+int TaskPool::get_n_threads() const noexcept {
+    return n_workers + 1;
+}
+
+void TaskPool::parallel_for(const int n_tasks, const std::function<void(int, int)>& task) {
+    if(n_tasks <= 0)
+        return;
+    const int caller_id = n_workers;
+    if(n_tasks == 1 || n_workers == 0) {
+        for(int task_id = 0; task_id < n_tasks; ++task_id)
+            task(task_id, caller_id);
+        return;
+    }
+
+    //Contiguous ranges keep neighbouring tasks, e.g. neighbouring tiles, on the same thread unless work is stolen
+    std::shared_ptr<job> current_job = std::make_shared<job>();
+    current_job->task = &task;
+    current_job->ranges.reset(new task_range[get_n_threads()]);
+    current_job->n_unfinished = n_tasks;
+    for(int thread_id = 0; thread_id < get_n_threads(); ++thread_id) {
+        current_job->ranges[thread_id].begin = static_cast<int>(static_cast<long long>(n_tasks) * thread_id / get_n_threads());
+        current_job->ranges[thread_id].end = static_cast<int>(static_cast<long long>(n_tasks) * (thread_id + 1) / get_n_threads());
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(current_job);
+    }
+    jobs_changed.notify_all();
+
+    run(*current_job, caller_id, nullptr);
+    retire(current_job);
+    std::unique_lock<std::mutex> lock(current_job->mutex);
+    current_job->finished.wait(lock, [&current_job] { return current_job->n_unfinished.load() == 0; });
+}
+
+std::vector<worker_utilisation> TaskPool::get_utilisation() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - statistics_start).count();
+    std::vector<worker_utilisation> utilisation;
+    for(int worker_id = 0; worker_id < n_workers; ++worker_id)
+        utilisation.push_back({workers[worker_id].busy_nanoseconds.load() * 1e-9, wall_seconds,
+                               workers[worker_id].n_tasks.load(), workers[worker_id].n_steals.load()});
+    return utilisation;
+}
+
+void TaskPool::reset_utilisation() {
+    std::lock_guard<std::mutex> lock(mutex);
+    statistics_start = std::chrono::steady_clock::now();
+    for(int worker_id = 0; worker_id < n_workers; ++worker_id) {
+        workers[worker_id].busy_nanoseconds = 0;
+        workers[worker_id].n_tasks = 0;
+        workers[worker_id].n_steals = 0;
+    }
+}
+
+//Worker thread: Helps with the running jobs in turn, sleeps while there are none
+void TaskPool::work(const int worker_id) {
+    while(true) {
+        std::shared_ptr<job> current_job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobs_changed.wait(lock, [this] { return shutdown || !jobs.empty(); });
+            if(shutdown)
+                return;
+            current_job = jobs[next_job++ % jobs.size()];
+        }
+        run(*current_job, worker_id, &workers[worker_id]);
+        retire(current_job);
+    }
+}
+
+//Runs tasks of the job until none are left to take; state is null for calling threads, which are not accounted
+void TaskPool::run(job& current_job, const int thread_id, worker_state* state) {
+    int task_id;
+    while(take(current_job, thread_id, task_id, state)) {
+        const auto start = std::chrono::steady_clock::now();
+        (*current_job.task)(task_id, thread_id);
+        if(state) {
+            state->busy_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            ++state->n_tasks;
+        }
+        if(current_job.n_unfinished.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(current_job.mutex);
+            current_job.finished.notify_all();
+        }
+    }
+}
+
+//Takes the next task of the thread's own range, or steals the back half of another thread's range
+bool TaskPool::take(job& current_job, const int thread_id, int& task_id, worker_state* state) {
+    task_range& own = current_job.ranges[thread_id];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(own.begin < own.end) {
+            task_id = own.begin++;
+            return true;
+        }
+    }
+
+    for(int offset = 1; offset < get_n_threads(); ++offset) {
+        task_range& victim = current_job.ranges[(thread_id + offset) % get_n_threads()];
+        int stolen_begin, stolen_end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if(victim.begin >= victim.end)
+                continue;
+            stolen_begin = victim.begin + (victim.end - victim.begin) / 2;
+            stolen_end = victim.end;
+            victim.end = stolen_begin;
+        }
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.begin = stolen_begin + 1;
+            own.end = stolen_end;
+        }
+        if(state)
+            ++state->n_steals;
+        task_id = stolen_begin;
+        return true;
+    }
+    return false;
+}
+
+//Removes a job without tasks left to take, so that idle workers stop visiting it
+void TaskPool::retire(const std::shared_ptr<job>& current_job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto position = std::find(jobs.begin(), jobs.end(), current_job);
+    if(position != jobs.end())
+        jobs.erase(position);
+}
@@ -20,11 +20,11 @@ along with this program. If not, see <http://www.gnu.org/licenses/>. */
 
 //OpenCV
 #include <opencv2/core.hpp>
-#include <opencv2/objdetect.hpp>
 
 //QT5
 #include <QApplication>
 #include <QFileDialog>
+#include <QTimer>
 #include <QtWidgets/QHBoxLayout>
 #include <QtWidgets/QPushButton>
 #include <QtWidgets/QLabel>
@@ -42,10 +42,11 @@ along with this program. If not, see <http://www.gnu.org/licenses/>. */
 //Project internal
 #include <mainwindow.h>
 #include <video_source.h>
-#include <include/processing/spatial_filter.h>
-#include <include/processing/temporal_filter.h>
-#include <include/processing/analysis.h>
+#include <include/processing/pipeline.h>
+#include <include/processing/face_tracker.h>
+#include <include/processing/frame_conversion.h>
 #include <helpers/QImageWidget.h>
+#include <helpers/fftw_planner.h>
 
 using std::string;
 
@@ -58,9 +59,15 @@ void sync_gui_with_parameter_store(MainWindow& window, parameter_store& params)
         window.findChild<QComboBox*>("cb_spatialFilter")->setCurrentIndex(1);
     else if(params.spatial_filter == spatial_filter_type::LAPLACIAN)
         window.findChild<QComboBox*>("cb_spatialFilter")->setCurrentIndex(2);
+    else if(params.spatial_filter == spatial_filter_type::RIESZ)
+        window.findChild<QComboBox*>("cb_spatialFilter")->setCurrentIndex(3);
 
-    if(params.temporal_filter == temporal_filter_type::IDEAL)
+    if(params.temporal_filter == temporal_filter_type::IDEAL &&
+            params.ideal_filter_engine == ideal_filter_engine_type::FFTW)
         window.findChild<QComboBox*>("cb_temporalFilter")->setCurrentIndex(0);
+    else if(params.temporal_filter == temporal_filter_type::IDEAL &&
+            params.ideal_filter_engine == ideal_filter_engine_type::SLIDING_DFT)
+        window.findChild<QComboBox*>("cb_temporalFilter")->setCurrentIndex(2);
     else if(params.temporal_filter == temporal_filter_type::IIR)
         window.findChild<QComboBox*>("cb_temporalFilter")->setCurrentIndex(1);
 
@@ -117,42 +124,6 @@ void sync_gui_with_parameter_store(MainWindow& window, parameter_store& params)
     window.findChild<QCheckBox*>("chb_analyzeHeartbeat")->setChecked(params.analyze_heartbeat);
 }
 
-void reset_parameters(parameter_store& params) {
-    //Filter types
-    params.spatial_filter = spatial_filter_type::NONE; //Reset all parameters and sync with GUI
-    params.temporal_filter = temporal_filter_type::IDEAL;
-
-    //Color
-    params.color_convert_forward = -1;
-    params.color_convert_backward = CV_BGR2RGB;
-    params.active_channels = std::vector<bool>{true, true, true};
-
-    //Spatial filter parameters
-    params.roi_rect = cv::Rect(0,0,0,0);
-    params.n_buffered_frames = 5; //Seconds, will be multiplied by fps
-    params.n_layers = 3;
-
-    //Temporal filter parameters
-    params.alpha = 50.f;
-    params.lambda_c = 100.f;
-    params.min_freq = 1.f;
-    params.max_freq = 2.f;
-    params.cutoffLo = .25f;
-    params.cutoffHi = .6f;
-
-    //Video output parameters
-    params.write_to_file = false;
-    params.convert_whole_video = false;
-    params.output_fourcc = cv::VideoWriter::fourcc('M','P','4','2');
-    std::string video_output_filename = "";
-
-    //Misc
-    params.fps = 1;
-    params.n_channels = 3;
-    params.analyze_heartbeat = false;
-    params.shutdown = false;
-}
-
 //Handle an error by displaying a simple message box
 void handle_error(string message) {
     QMessageBox msgBox;
@@ -199,7 +170,28 @@ void setup_v4l2_controls(VideoSource& video_source, MainWindow& window) {
 
     //Add GUI elements for all options
     for(auto option : options) {
-        if(option.type == v4l2_option_type::INTEGER || option.type == v4l2_option_type::MENU) {
+        if(option.type == v4l2_option_type::MENU && !option.menu_entries.empty()) {
+            QHBoxLayout* combobox_layout = new QHBoxLayout; //Combines name label and combobox
+
+            QComboBox* combobox = new QComboBox;
+            for(const std::string& entry : option.menu_entries)
+                combobox->addItem(QString::fromStdString(entry));
+            combobox->setCurrentIndex(option.current - option.minimum);
+            combobox->setEnabled(!option.read_only);
+
+            combobox_layout->addWidget(new QLabel(QString::fromStdString(option.name)));
+            combobox_layout->addWidget(combobox);
+
+            QObject::connect(
+                    combobox, //Connect to functionality
+                    static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+                    [combobox, &video_source, option](int index) {
+                        int set_value = video_source.set_option_value(option, option.minimum + index);
+                        combobox->setCurrentIndex(set_value - option.minimum);
+                    });
+
+            camera_parameters_container->addLayout(combobox_layout); //Add the combobox layout to the global layout
+        } else if(option.type == v4l2_option_type::INTEGER || option.type == v4l2_option_type::MENU) {
             QHBoxLayout* slider_layout = new QHBoxLayout; //Combines name label, slider and value label
 
             QLabel* name_label = new QLabel(QString::fromStdString(option.name)); //Setup labels
@@ -210,6 +202,7 @@ void setup_v4l2_controls(VideoSource& video_source, MainWindow& window) {
             slider->setMaximum(option.maximum);
             slider->setValue(option.current);
             slider->setTracking(false);
+            slider->setEnabled(!option.read_only);
 
             slider_layout->addWidget(name_label);
             slider_layout->addWidget(slider); //Add these widgets to layout
@@ -228,6 +221,7 @@ void setup_v4l2_controls(VideoSource& video_source, MainWindow& window) {
         } else if(option.type == v4l2_option_type::BOOLEAN) {
             QCheckBox* checkbox = new QCheckBox(QString::fromStdString(option.name));
             checkbox->setChecked(option.current);
+            checkbox->setEnabled(!option.read_only);
 
             QObject::connect(
                     checkbox, //Connect to functionality
@@ -242,29 +236,15 @@ void setup_v4l2_controls(VideoSource& video_source, MainWindow& window) {
     }
 }
 
-/**
-* Detects a single(!) face in a given image using OpenCV's CascadeClassifier and a pretrained classifier
-* All detections are combined into one cv::Rect; this is then returned
-* A rect with the size of the input image is returned if no face has been detected
-*/
-cv::Rect simple_face_detection(const cv::Mat& image) noexcept {
-    std::vector<cv::Rect> detections;
-    cv::CascadeClassifier classifier(FACE_CLASSIFIER_FILE); //Macro will be set by CMake
-    classifier.detectMultiScale(image, detections);
-    if(detections.size() == 0)
-        return cv::Rect(0, 0, image.cols, image.rows);
-    cv::Rect detection_rect = detections[0];
-    for(int detection_id = 1; detection_id < detections.size(); ++detection_id)
-        detection_rect = detection_rect | detections[detection_id];
-    return detection_rect;
-}
-
 int main(int argc, char** argv) {
     //QApplication setup
     QApplication a(argc, argv);
     MainWindow window;
     window.show();
 
+    //Plans measured in earlier sessions are available right away, the ones measured in this session are kept
+    FFTWPlanner::instance().load_wisdom(FFTWPlanner::default_wisdom_filename());
+
     //Add custom frame widget for live preview
     QImageWidget live_preview_image_widget;
     window.findChild<QHBoxLayout*>("layout_output")->setAlignment(Qt::AlignCenter);
@@ -297,6 +277,34 @@ int main(int argc, char** argv) {
 
     std::thread processing_thread;
 
+    //Heartbeat analysis runs on a thread of its own, its results are plotted on the GUI thread whenever one is ready
+    HeartbeatAnalyzer heartbeat_analyzer;
+    QTimer analysis_timer;
+    QObject::connect(&analysis_timer, &QTimer::timeout,
+                     [&heartbeat_analyzer, &window, &custom_plot_time, &custom_plot_frequency,
+                     time_graph, frequency_bars]() {
+        std::vector<analysis_data> analysis_results;
+        if(!heartbeat_analyzer.poll(analysis_results) || analysis_results.empty() ||
+                analysis_results.front().timedomain_keys.empty())
+            return;
+        const analysis_data& analysis_result = analysis_results.front(); //The GUI only selects a single ROI
+
+        time_graph->keyAxis()->setRange(0, analysis_result.timedomain_keys[analysis_result.timedomain_keys.size()-1]);
+        time_graph->valueAxis()->setRange(0, 1);
+        time_graph->setData(QVector<double>::fromStdVector(analysis_result.timedomain_keys),
+                            QVector<double>::fromStdVector(analysis_result.timedomain_values));
+        custom_plot_time.replot();
+
+        frequency_bars->keyAxis()->setRange(0, analysis_result.frequencydomain_keys[analysis_result.frequencydomain_keys.size()-1]);
+        frequency_bars->valueAxis()->setRange(0, 1);
+        frequency_bars->setData(QVector<double>::fromStdVector(analysis_result.frequencydomain_keys),
+                                QVector<double>::fromStdVector(analysis_result.frequencydomain_values));
+        custom_plot_frequency.replot();
+
+        window.findChild<QLCDNumber*>("lcd_heartbeatNumber")->display(analysis_result.heartbeat_number);
+    });
+    analysis_timer.start(50);
+
     //Mouse selection handling
     mouse_selection selection;
     QObject::connect(&live_preview_image_widget,
@@ -306,105 +314,84 @@ int main(int argc, char** argv) {
     });
 
     auto main_lambda = [&params, &selection, &processing_thread,
-            &video_source, &video_writer,
-            &window, &live_preview_image_widget, &custom_plot_time, &custom_plot_frequency,
-            time_graph, frequency_bars]() {
+            &video_source, &video_writer, &heartbeat_analyzer,
+            &window, &live_preview_image_widget]() {
         params.shutdown = false;
         processing_thread = std::thread([&params, &selection,
-                        &video_source, &video_writer,
-                        &window, &live_preview_image_widget, &custom_plot_time, &custom_plot_frequency,
-                        time_graph, frequency_bars]() {
-            cv::Mat frame;
-            cv::Rect selection_rect;
-            cv::Scalar roi_color; //Use different colors to draw the selected roi
-            DataContainer data_container(params);
+                        &video_source, &video_writer, &heartbeat_analyzer,
+                        &window, &live_preview_image_widget]() {
+            FaceTracker face_tracker(FACE_CLASSIFIER_FILE); //Macro will be set by CMake
             parameter_store buffered_params;
+            buffered_params.n_layers = 0; //Forces the roi rect to be aligned for the first frame
+            auto last_frame_time = std::chrono::high_resolution_clock::now();
             set_gui_enabled(true, window);
-            while(!params.shutdown) {
+
+            //Decode stage: Grab a frame and buffer the parameters it is processed with
+            auto source = [&params, &selection, &video_source, &face_tracker,
+                    &buffered_params, &last_frame_time](frame_packet& packet) {
+                if(params.shutdown)
+                    return false;
+
                 if(params.n_layers != buffered_params.n_layers) //Re-align the roi rect if number of layers has changed
                     params.roi_rect = align_rect(params.roi_rect, params.n_layers);
                 buffered_params = params; //Buffer params per frame
 
-                auto start = std::chrono::high_resolution_clock::now();
-
-                video_source >> frame;
+                //Only wait for the next frame to be due if the whole video is not being converted
+                if(!buffered_params.write_to_file || !buffered_params.convert_whole_video)
+                    std::this_thread::sleep_for(std::chrono::duration<int, std::ratio<1,1000>>(1000/buffered_params.fps)
+                                                - (std::chrono::high_resolution_clock::now() - last_frame_time));
+                last_frame_time = std::chrono::high_resolution_clock::now();
 
-                if (buffered_params.color_convert_forward > 0)
-                    cv::cvtColor(frame, frame, buffered_params.color_convert_forward);
+                video_source.read_raw(packet.frame);
+                packet.pixel_format = video_source.get_raw_pixel_format();
+                packet.first_playback = video_source.is_first_playback();
+                packet.capture_time = video_source.get_capture_time();
 
                 if(!selection.complete && !selection.selecting &&
                         buffered_params.spatial_filter == spatial_filter_type::NONE) {
-                    selection_rect = params.roi_rect = buffered_params.roi_rect =
-                            align_rect(simple_face_detection(frame), buffered_params.n_layers);
-                    roi_color = cv::Scalar(0, 0, 255);
+                    const cv::Mat luma = frame_conversion::get_luma(packet.frame, packet.pixel_format);
+                    packet.selection_rect = params.roi_rect = buffered_params.roi_rect =
+                            align_rect(face_tracker.update(luma), buffered_params.n_layers);
+                    packet.selection_color = cv::Scalar(0, 0, 255);
                 } else if(selection.fresh && selection.complete && !selection.selecting) {
-                    selection_rect = params.roi_rect = buffered_params.roi_rect =
+                    packet.selection_rect = params.roi_rect = buffered_params.roi_rect =
                             align_rect(selection.rect(), buffered_params.n_layers);
-                    roi_color = cv::Scalar(0, 255, 0);
+                    packet.selection_color = cv::Scalar(0, 255, 0);
                 } else if(selection.fresh && !selection.complete && selection.selecting) {
-                    selection_rect = selection.rect();
-                    roi_color = cv::Scalar(255, 255, 0);
+                    packet.selection_rect = selection.rect();
+                    packet.selection_color = cv::Scalar(255, 255, 0);
                 } else {
-                    selection_rect = buffered_params.roi_rect;
-                }
-
-                frame.convertTo(frame, CV_32FC3);
-                data_container.push_frame(frame, buffered_params);
-
-                if(buffered_params.spatial_filter != spatial_filter_type::NONE) {
-                    if (buffered_params.temporal_filter == temporal_filter_type::IDEAL) {
-                        spatial_filter::spatial_decomp(buffered_params, data_container);
-                        temporal_filter::ideal_filter(buffered_params, data_container);
-                        spatial_filter::spatial_comp(buffered_params, data_container);
-                    } else if(buffered_params.temporal_filter == temporal_filter_type::IIR) {
-                        spatial_filter::spatial_decomp(buffered_params, data_container);
-                        temporal_filter::iir_filter(buffered_params, data_container);
-                        spatial_filter::spatial_comp(buffered_params, data_container);
-                    }
+                    packet.selection_rect = buffered_params.roi_rect;
                 }
 
-                data_container.pop_frame().convertTo(frame, CV_8UC3);
+                packet.params = buffered_params;
+                return true;
+            };
 
-                if (buffered_params.analyze_heartbeat) {
-                    auto analysis_result = analysis::analyze_heartbeat(buffered_params, data_container);
+            //Encode/preview stage: Show the processed frame and write it to file
+            auto sink = [&params, &video_writer, &window, &live_preview_image_widget](frame_packet& packet) {
+                cv::Mat& frame = packet.frame;
 
-                    time_graph->keyAxis()->setRange(0, analysis_result.timedomain_keys[analysis_result.timedomain_keys.size()-1]);
-                    time_graph->valueAxis()->setRange(0, 1);
-                    time_graph->setData(QVector<double>::fromStdVector(analysis_result.timedomain_keys),
-                                        QVector<double>::fromStdVector(analysis_result.timedomain_values));
-                    custom_plot_time.replot();
+                //Scaled down and handed over to the GUI thread, which only shows the latest preview
+                live_preview_image_widget.imshow(frame, packet.selection_rect, packet.selection_color);
 
-                    frequency_bars->keyAxis()->setRange(0, analysis_result.frequencydomain_keys[analysis_result.frequencydomain_keys.size()-1]);
-                    frequency_bars->valueAxis()->setRange(0, 1);
-                    frequency_bars->setData(QVector<double>::fromStdVector(analysis_result.frequencydomain_keys),
-                                            QVector<double>::fromStdVector(analysis_result.frequencydomain_values));
-                    custom_plot_frequency.replot();
-
-                    window.findChild<QLCDNumber*>("lcd_heartbeatNumber")->display(analysis_result.heartbeat_number);
-                }
-
-                cv::cvtColor(frame, frame, buffered_params.color_convert_backward);
-                cv::rectangle(frame, selection_rect, roi_color); //Draw to preview widget
-                live_preview_image_widget.imshow(frame);
-
-                if(buffered_params.write_to_file) {
-                    if(buffered_params.convert_whole_video && !video_source.is_first_playback()) {
+                if(packet.params.write_to_file && video_writer.isOpened()) {
+                    if(packet.params.convert_whole_video && !packet.first_playback) {
                         params.write_to_file = false;
                         video_writer.release();
                         params.video_output_filename = "";
+                        params.temporal_buffer_storage = temporal_buffer_storage_type::MEMORY;
                         window.findChild<QPushButton*>("btn_startStopConvertVideo")->setText("Convert whole video");
                         window.findChild<QLabel*>("lbl_outputFilename")->setText("No file selected");
                         set_gui_enabled(true, window);
                     } else {
-                        cv::cvtColor(frame, frame, CV_RGB2BGR);
                         video_writer.write(frame);
                     }
                 }
+            };
 
-                auto end = std::chrono::high_resolution_clock::now();
-                if(!buffered_params.write_to_file || !buffered_params.convert_whole_video)
-                    std::this_thread::sleep_for(std::chrono::duration<int, std::ratio<1,1000>>(1000/buffered_params.fps)-(end-start));
-            }
+            FramePipeline pipeline(4, &heartbeat_analyzer);
+            pipeline.run(source, sink);
         });
         processing_thread.detach();
     };
@@ -499,13 +486,13 @@ int main(int argc, char** argv) {
             static_cast<void (QComboBox::*)(int)>(&QComboBox::activated),
             [&params](int index){
                 switch(index) {
-                    case 0: params.color_convert_forward = -1; params.color_convert_backward = CV_BGR2RGB; break;
-                    case 1: params.color_convert_forward = CV_BGR2XYZ; params.color_convert_backward = CV_XYZ2RGB; break;
-                    case 2: params.color_convert_forward = CV_BGR2YCrCb; params.color_convert_backward = CV_YCrCb2RGB; break;
-                    case 3: params.color_convert_forward = CV_BGR2HSV; params.color_convert_backward = CV_HSV2RGB; break;
-                    case 4: params.color_convert_forward = CV_BGR2Lab; params.color_convert_backward = CV_Lab2RGB; break;
-                    case 5: params.color_convert_forward = CV_BGR2Luv; params.color_convert_backward = CV_Luv2RGB; break;
-                    case 6: params.color_convert_forward = CV_BGR2YUV; params.color_convert_backward = CV_YUV2RGB; break;
+                    case 0: params.color_convert_forward = -1; params.color_convert_backward = -1; break;
+                    case 1: params.color_convert_forward = CV_BGR2XYZ; params.color_convert_backward = CV_XYZ2BGR; break;
+                    case 2: params.color_convert_forward = CV_BGR2YCrCb; params.color_convert_backward = CV_YCrCb2BGR; break;
+                    case 3: params.color_convert_forward = CV_BGR2HSV; params.color_convert_backward = CV_HSV2BGR; break;
+                    case 4: params.color_convert_forward = CV_BGR2Lab; params.color_convert_backward = CV_Lab2BGR; break;
+                    case 5: params.color_convert_forward = CV_BGR2Luv; params.color_convert_backward = CV_Luv2BGR; break;
+                    case 6: params.color_convert_forward = CV_BGR2YUV; params.color_convert_backward = CV_YUV2BGR; break;
                     default: break;
                 }
     });
@@ -546,6 +533,8 @@ int main(int argc, char** argv) {
                     params.spatial_filter = spatial_filter_type::GAUSSIAN;
                 if(index == 2)
                     params.spatial_filter = spatial_filter_type::LAPLACIAN;
+                if(index == 3)
+                    params.spatial_filter = spatial_filter_type::RIESZ;
                 sync_gui_with_parameter_store(window, params);
     });
 
@@ -554,10 +543,16 @@ int main(int argc, char** argv) {
             window.findChild<QComboBox*>("cb_temporalFilter"),
             static_cast<void (QComboBox::*)(int)>(&QComboBox::activated),
             [&params, &window](int index){
-                if(index == 0)
+                if(index == 0) {
                     params.temporal_filter = temporal_filter_type::IDEAL;
+                    params.ideal_filter_engine = ideal_filter_engine_type::FFTW;
+                }
                 if(index == 1)
                     params.temporal_filter = temporal_filter_type::IIR;
+                if(index == 2) {
+                    params.temporal_filter = temporal_filter_type::IDEAL;
+                    params.ideal_filter_engine = ideal_filter_engine_type::SLIDING_DFT;
+                }
                 sync_gui_with_parameter_store(window, params);
     });
 
@@ -681,10 +676,13 @@ int main(int argc, char** argv) {
                                           params.fps, video_source.get_frame_size());
                         window.findChild<QPushButton *>("btn_startStopConvertVideo")->setText("Stop");
                         params.n_buffered_frames = video_source.get_n_frames();
+                        //The whole video's history may not fit into RAM
+                        params.temporal_buffer_storage = temporal_buffer_storage_type::MAPPED_FILE;
                         window.findChild<QWidget *>("tab_videoInput")->setEnabled(false);
                     } else {
                         video_writer.release();
                         params.video_output_filename = "";
+                        params.temporal_buffer_storage = temporal_buffer_storage_type::MEMORY;
                         window.findChild<QPushButton *>("btn_startStopConvertVideo")->setText("Convert whole video");
                         window.findChild<QLabel *>("lbl_outputFilename")->setText("No file selected");
                         window.findChild<QWidget *>("tab_videoInput")->setEnabled(true);
@@ -718,5 +716,7 @@ int main(int argc, char** argv) {
     });
 
     //Start the main Qt event loop
-    return a.exec();
+    const int exit_code = a.exec();
+    FFTWPlanner::instance().save_wisdom(FFTWPlanner::default_wisdom_filename());
+    return exit_code;
 }
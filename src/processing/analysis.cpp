@@ -1,91 +1,242 @@
 #include <include/processing/analysis.h>
 
-#include <fftw3.h>
-
-namespace analysis {
-
-    analysis_data analyze_heartbeat(parameter_store& params, DataContainer& data_container) {
-        cv::Mat_<float> averaged_pixels = data_container.get_average_roi_pixels();
-
-        //fftwf forward produces buffered_frames/2+1 complex numbers, i.e. buffered_frames+2 floats
-        cv::Mat_<float> fft_forward_output(params.n_channels, params.n_buffered_frames+2);
-
-        static int n_frames_last_plan = 0;
-        static fftwf_plan forward_plan;
-        if(params.n_buffered_frames != n_frames_last_plan) {
-            fftwf_destroy_plan(forward_plan);
-            forward_plan = fftwf_plan_dft_r2c_1d(
-                    params.n_buffered_frames,
-                    averaged_pixels.ptr<float>(0),
-                    reinterpret_cast<fftwf_complex *>(fft_forward_output.ptr<float>(0)),
-                    FFTW_MEASURE);
-            n_frames_last_plan = params.n_buffered_frames;
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//Band of plausible heart rates in Hz (40 to 200 bpm) and the spacing of the zoomed spectrum within it (0.5 bpm)
+static const double heartbeat_min_frequency = 40. / 60.;
+static const double heartbeat_max_frequency = 200. / 60.;
+static const double heartbeat_frequency_step = .5 / 60.;
+
+HeartbeatAnalyzer::HeartbeatAnalyzer() : update_period(std::chrono::steady_clock::duration::zero()) {
+    analysis_thread = std::thread(&HeartbeatAnalyzer::analysis_loop, this);
+}
+
+HeartbeatAnalyzer::~HeartbeatAnalyzer() {
+    {
+        std::lock_guard<std::mutex> lock(analysis_mutex);
+        shutdown = true;
+    }
+    samples_queued.notify_one();
+    analysis_thread.join();
+}
+
+void HeartbeatAnalyzer::push(const std::vector<cv::Scalar>& roi_means, const parameter_store& params) {
+    {
+        std::lock_guard<std::mutex> lock(analysis_mutex);
+        pending_samples.push_back({roi_means, params.fps, params.n_buffered_frames, std::min(params.n_channels, 4),
+                                   params.analysis_update_rate});
+    }
+    samples_queued.notify_one();
+}
+
+bool HeartbeatAnalyzer::poll(std::vector<analysis_data>& results) {
+    std::lock_guard<std::mutex> lock(analysis_mutex);
+    if(!has_new_result)
+        return false;
+    results = latest_results;
+    has_new_result = false;
+    return true;
+}
+
+std::vector<analysis_data> HeartbeatAnalyzer::finish() {
+    std::unique_lock<std::mutex> lock(analysis_mutex);
+    finish_requested = true;
+    samples_queued.notify_one();
+    finish_done.wait(lock, [this]() { return !finish_requested; });
+    has_new_result = false;
+    return latest_results;
+}
+
+//Drains the queued means as they come in; results are published once per update period, or right away when finishing
+void HeartbeatAnalyzer::analysis_loop() {
+    std::chrono::steady_clock::time_point next_update = std::chrono::steady_clock::now();
+    bool unpublished = false;
+    std::unique_lock<std::mutex> lock(analysis_mutex);
+    while(true) {
+        auto ready = [this]() { return shutdown || finish_requested || !pending_samples.empty(); };
+        if(unpublished)
+            samples_queued.wait_until(lock, next_update, ready);
+        else
+            samples_queued.wait(lock, ready);
+        if(shutdown)
+            return;
+
+        std::deque<roi_sample> samples;
+        samples.swap(pending_samples);
+        const bool finishing = finish_requested;
+        lock.unlock();
+
+        for(const roi_sample& sample : samples)
+            add_sample(sample);
+        unpublished = unpublished || !samples.empty();
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        const bool publish = n_frames > 0 && (finishing || (unpublished && now >= next_update));
+        std::vector<analysis_data> results;
+        if(publish) {
+            results = analyze();
+            next_update = now + update_period;
+            unpublished = false;
+        }
+
+        lock.lock();
+        if(publish) {
+            latest_results = std::move(results);
+            has_new_result = true;
+        }
+        if(finishing) {
+            finish_requested = false;
+            finish_done.notify_all();
+        }
+    }
+}
+
+//Replaces the oldest mean and updates all bins with the difference; the bins are recalculated from the history once
+//per n_frames samples, so rounding errors cannot accumulate
+void HeartbeatAnalyzer::add_sample(const roi_sample& sample) {
+    const int n_sample_rois = static_cast<int>(sample.means.size());
+    if(sample.fps != fps || sample.n_buffered_frames != n_frames || sample.n_channels != n_channels ||
+            n_sample_rois != n_rois) {
+        fps = sample.fps;
+        n_frames = std::max(sample.n_buffered_frames, 1);
+        n_channels = sample.n_channels;
+        n_rois = n_sample_rois;
+        position = 0;
+        n_updates = 0;
+        history = cv::Mat_<double>::zeros(n_rois * n_channels, n_frames);
+        bins = cv::Mat_<double>::zeros(n_rois * n_channels, 2 * (n_frames / 2 + 1));
+    }
+    update_period = sample.update_rate > 0.f ?
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1. / sample.update_rate)) :
+            std::chrono::steady_clock::duration::zero();
+
+    //exp(-2*pi*i*k*position/n_frames) for k = 0, 1, ... by repeated rotation
+    const double angle = -2. * CV_PI * position / n_frames;
+    const double rotation_real = std::cos(angle), rotation_imaginary = std::sin(angle);
+    for(int row = 0; row < history.rows; ++row) {
+        const double mean = sample.means[row / n_channels][row % n_channels];
+        const double delta = mean - history(row, position);
+        history(row, position) = mean;
+        double* channel_bins = bins.ptr<double>(row);
+        double twiddle_real = 1., twiddle_imaginary = 0.;
+        for(int bin_id = 0; bin_id < bins.cols / 2; ++bin_id) {
+            channel_bins[2 * bin_id] += delta * twiddle_real;
+            channel_bins[2 * bin_id + 1] += delta * twiddle_imaginary;
+            const double next_real = twiddle_real * rotation_real - twiddle_imaginary * rotation_imaginary;
+            twiddle_imaginary = twiddle_real * rotation_imaginary + twiddle_imaginary * rotation_real;
+            twiddle_real = next_real;
         }
+    }
+    position = (position + 1) % n_frames;
+    if(++n_updates >= n_frames) {
+        refresh_spectrum();
+        n_updates = 0;
+    }
+}
 
-        //Using double from here on as the plotting widget requires double precision
-        cv::Mat_<double> magnitudes = cv::Mat_<double>::zeros(3, fft_forward_output.cols/2);
-        for (int channel_id = 0; channel_id < params.n_channels; ++channel_id) {
-            fftwf_execute_dft_r2c(forward_plan,
-                                 averaged_pixels.ptr<float>(channel_id),
-                                 reinterpret_cast<fftwf_complex*>(fft_forward_output.ptr<float>(channel_id)));
-            //Manually calculate magnitudes while skipping DC component
-            for(int i = 2; i < fft_forward_output.cols; i+=2) {
-                magnitudes.at<double>(channel_id, i / 2) = std::sqrt(
-                        std::pow(fft_forward_output.at<float>(channel_id, i), 2) +
-                        std::pow(fft_forward_output.at<float>(channel_id, i + 1), 2));
+void HeartbeatAnalyzer::refresh_spectrum() {
+    bins.setTo(0.);
+    for(int bin_id = 0; bin_id < bins.cols / 2; ++bin_id) {
+        for(int frame_id = 0; frame_id < n_frames; ++frame_id) {
+            const double angle = -2. * CV_PI * static_cast<double>(static_cast<long long>(bin_id) * frame_id % n_frames) / n_frames;
+            const double twiddle_real = std::cos(angle), twiddle_imaginary = std::sin(angle);
+            for(int row = 0; row < history.rows; ++row) {
+                bins(row, 2 * bin_id) += history(row, frame_id) * twiddle_real;
+                bins(row, 2 * bin_id + 1) += history(row, frame_id) * twiddle_imaginary;
             }
         }
+    }
+}
 
+//Heartbeat and plot data of each ROI, taken from the channel whose spectrum is the least noisy
+std::vector<analysis_data> HeartbeatAnalyzer::analyze() const {
+    //Magnitudes while skipping the DC component
+    cv::Mat_<double> magnitudes = cv::Mat_<double>::zeros(history.rows, bins.cols / 2);
+    for(int row = 0; row < history.rows; ++row)
+        for(int bin_id = 1; bin_id < magnitudes.cols; ++bin_id)
+            magnitudes(row, bin_id) = std::hypot(bins(row, 2 * bin_id), bins(row, 2 * bin_id + 1));
+
+    std::vector<analysis_data> results(n_rois);
+    for(int roi_id = 0; roi_id < n_rois; ++roi_id) {
         //Find the "best" channel (i.e. the channel with the lowest std deviation)
-        int best_channel = 0;
+        const int first_row = roi_id * n_channels;
+        int best_row = first_row;
         cv::Scalar mean, std_deviation, min_std_deviation;
-        cv::meanStdDev(magnitudes.row(0), mean, std_deviation);
+        cv::meanStdDev(magnitudes.row(first_row), mean, std_deviation);
         min_std_deviation = std_deviation;
-        for (int channel_id = 1; channel_id < params.n_channels; ++channel_id) {
-            cv::meanStdDev(magnitudes.row(channel_id), mean, std_deviation);
+        for (int row = first_row + 1; row < first_row + n_channels; ++row) {
+            cv::meanStdDev(magnitudes.row(row), mean, std_deviation);
             if (std_deviation[0] < min_std_deviation[0]) { //cv Scalar std_deviation only holds one value
                 min_std_deviation = std_deviation;
-                best_channel = channel_id;
+                best_row = row;
             }
         }
 
-        //Scale results to [0,1]
+        analysis_data& result = results[roi_id];
+        result.timedomain_keys.resize(n_frames);
+        result.timedomain_values.resize(n_frames);
+        result.frequencydomain_keys.resize(magnitudes.cols);
+        result.frequencydomain_values.resize(magnitudes.cols);
+
+        //Scale results to [0,1]; the time domain is plotted from the oldest to the newest mean
         double min, max;
-        cv::minMaxLoc(averaged_pixels.row(best_channel), &min, &max);
-        cv::Mat_<double> values_timedomain_mat = (averaged_pixels.row(best_channel) - min)/(max-min);
-
-        int min_idx[2], max_idx[2];
-        cv::minMaxIdx(magnitudes.row(best_channel), &min, &max, min_idx, max_idx);
-        cv::Mat_<double> values_frequencydomain_mat = (magnitudes.row(best_channel) - min)/(max-min);
-
-        //Calculate the current heartbeat
-        double heartbeat_value = static_cast<double>(max_idx[1]);
-        heartbeat_value *= static_cast<double>(params.fps);
-        heartbeat_value /= static_cast<double>(params.n_buffered_frames);
-        heartbeat_value *= 60.0;
-
-        std::vector<double> values_timedomain(values_timedomain_mat.cols);
-        values_timedomain_mat.copyTo(values_timedomain);
-        std::vector<double> values_frequencydomain(values_frequencydomain_mat.cols);
-        values_frequencydomain_mat.copyTo(values_frequencydomain);
-        std::vector<double> keys_timedomain(values_timedomain_mat.cols);
-        std::vector<double> keys_frequencydomain(values_frequencydomain_mat.cols);
-
-        for(int i = 0; i < values_timedomain_mat.cols; ++i) {
-            keys_timedomain[i] = static_cast<double>(i)/static_cast<double>(params.fps);
+        cv::minMaxLoc(history.row(best_row), &min, &max);
+        for(int i = 0; i < n_frames; ++i) {
+            result.timedomain_keys[i] = static_cast<double>(i) / static_cast<double>(fps);
+            result.timedomain_values[i] = max > min ? (history(best_row, (position + i) % n_frames) - min) / (max - min) : 0.;
+        }
+
+        cv::minMaxLoc(magnitudes.row(best_row), &min, &max);
+        for(int i = 0; i < magnitudes.cols; ++i) {
+            result.frequencydomain_keys[i] = static_cast<double>(i) * static_cast<double>(fps) / static_cast<double>(n_frames);
+            result.frequencydomain_values[i] = max > min ? (magnitudes(best_row, i) - min) / (max - min) : 0.;
         }
 
-        for(int i = 0; i < values_frequencydomain_mat.cols; ++i) {
-            keys_frequencydomain[i] = static_cast<double>(i) * static_cast<double>(params.fps) /
-                    static_cast<double>(params.n_buffered_frames);
+        result.heartbeat_number = estimate_heartbeat(best_row);
+    }
+    return results;
+}
+
+//Zooms into the heart-rate band instead of picking the strongest DFT bin, whose resolution of fps/n_frames would be
+//12 bpm for a 5 s window: The spectrum of the Hann-windowed, mean-free history is evaluated every 0.5 bpm within the
+//band and the peak is interpolated between its neighbours with a parabola
+double HeartbeatAnalyzer::estimate_heartbeat(const int row) const {
+    const double min_frequency = heartbeat_min_frequency;
+    const double max_frequency = std::min(heartbeat_max_frequency, fps / 2.);
+    if(n_frames < 3 || max_frequency <= min_frequency)
+        return 0.;
+
+    std::vector<double> samples(n_frames);
+    const double mean = cv::mean(history.row(row))[0];
+    for(int i = 0; i < n_frames; ++i)
+        samples[i] = (history(row, (position + i) % n_frames) - mean) *
+                     (.5 - .5 * std::cos(2. * CV_PI * i / (n_frames - 1)));
+
+    const int n_steps = static_cast<int>((max_frequency - min_frequency) / heartbeat_frequency_step) + 1;
+    std::vector<double> magnitudes(n_steps);
+    for(int step_id = 0; step_id < n_steps; ++step_id) {
+        //exp(-2*pi*i*f*t) for t = 0, 1/fps, ... by repeated rotation
+        const double angle = -2. * CV_PI * (min_frequency + step_id * heartbeat_frequency_step) / fps;
+        const double rotation_real = std::cos(angle), rotation_imaginary = std::sin(angle);
+        double twiddle_real = 1., twiddle_imaginary = 0., sum_real = 0., sum_imaginary = 0.;
+        for(int i = 0; i < n_frames; ++i) {
+            sum_real += samples[i] * twiddle_real;
+            sum_imaginary += samples[i] * twiddle_imaginary;
+            const double next_real = twiddle_real * rotation_real - twiddle_imaginary * rotation_imaginary;
+            twiddle_imaginary = twiddle_real * rotation_imaginary + twiddle_imaginary * rotation_real;
+            twiddle_real = next_real;
         }
+        magnitudes[step_id] = std::hypot(sum_real, sum_imaginary);
+    }
 
-        return analysis_data {
-                keys_timedomain,
-                values_timedomain,
-                keys_frequencydomain,
-                values_frequencydomain,
-                heartbeat_value
-        };
-    };
+    const int peak = static_cast<int>(std::max_element(magnitudes.begin(), magnitudes.end()) - magnitudes.begin());
+    double offset = 0.;
+    if(peak > 0 && peak < n_steps - 1) {
+        const double curvature = magnitudes[peak - 1] - 2. * magnitudes[peak] + magnitudes[peak + 1];
+        if(curvature < 0.)
+            offset = .5 * (magnitudes[peak - 1] - magnitudes[peak + 1]) / curvature;
+    }
+    return (min_frequency + (peak + offset) * heartbeat_frequency_step) * 60.;
 }
@@ -0,0 +1,92 @@
+#include <include/processing/face_tracker.h>
+
+#include <opencv2/imgproc.hpp>
+
+FaceTracker::FaceTracker(const std::string classifier_file, const int _detection_interval, const int _detection_width) :
+        classifier(classifier_file), detection_interval(_detection_interval), detection_width(_detection_width) {
+    detection_thread = std::thread(&FaceTracker::detection_loop, this);
+}
+
+FaceTracker::~FaceTracker() {
+    {
+        std::lock_guard<std::mutex> lock(detection_mutex);
+        shutdown = true;
+    }
+    detection_condition.notify_one();
+    detection_thread.join();
+}
+
+cv::Rect FaceTracker::update(const cv::Mat& frame) {
+    scale = std::min(1.0, static_cast<double>(detection_width) / frame.cols);
+    cv::Mat small_gray_frame;
+    if(frame.channels() == 1)
+        small_gray_frame = frame;
+    else
+        cv::cvtColor(frame, small_gray_frame, CV_BGR2GRAY);
+    cv::resize(small_gray_frame, small_gray_frame, cv::Size(), scale, scale, cv::INTER_AREA);
+
+    {
+        std::lock_guard<std::mutex> lock(detection_mutex);
+        if(detection_finished) { //Re-anchor the tracker on the latest detection
+            detection_finished = false;
+            if(detection_result.area() > 0) {
+                tracked_rect = detection_result & cv::Rect(0, 0, detection_input.cols, detection_input.rows);
+                face_template = detection_input(tracked_rect).clone();
+            }
+        }
+        if(!detection_pending && frame_id % detection_interval == 0) {
+            detection_input = small_gray_frame;
+            detection_pending = true;
+            detection_condition.notify_one();
+        }
+    }
+    ++frame_id;
+
+    if(face_template.empty())
+        return cv::Rect(0, 0, frame.cols, frame.rows);
+
+    track(small_gray_frame);
+    cv::Rect face_rect(cv::Point(static_cast<int>(tracked_rect.x / scale), static_cast<int>(tracked_rect.y / scale)),
+                       cv::Point(static_cast<int>(tracked_rect.br().x / scale), static_cast<int>(tracked_rect.br().y / scale)));
+    return face_rect & cv::Rect(0, 0, frame.cols, frame.rows);
+}
+
+void FaceTracker::detection_loop() {
+    std::unique_lock<std::mutex> lock(detection_mutex);
+    while(true) {
+        detection_condition.wait(lock, [this]() { return shutdown || detection_pending; });
+        if(shutdown)
+            return;
+
+        cv::Mat input = detection_input;
+        lock.unlock();
+        std::vector<cv::Rect> detections;
+        if(!classifier.empty())
+            classifier.detectMultiScale(input, detections);
+        cv::Rect detection_rect;
+        for(const cv::Rect& detection : detections)
+            detection_rect = detection_rect.area() == 0 ? detection : (detection_rect | detection);
+        lock.lock();
+
+        detection_result = detection_rect;
+        detection_pending = false;
+        detection_finished = true;
+    }
+}
+
+//Follows the face by matching the template from the last detection within a window around its last position
+void FaceTracker::track(const cv::Mat& small_gray_frame) {
+    cv::Rect search_rect(tracked_rect.x - tracked_rect.width / 2, tracked_rect.y - tracked_rect.height / 2,
+                         tracked_rect.width * 2, tracked_rect.height * 2);
+    search_rect &= cv::Rect(0, 0, small_gray_frame.cols, small_gray_frame.rows);
+    if(search_rect.width < face_template.cols || search_rect.height < face_template.rows)
+        return;
+
+    cv::Mat match_scores;
+    cv::matchTemplate(small_gray_frame(search_rect), face_template, match_scores, cv::TM_CCOEFF_NORMED);
+    double max_score;
+    cv::Point max_location;
+    cv::minMaxLoc(match_scores, nullptr, &max_score, nullptr, &max_location);
+    if(max_score > 0.5) //Keep the last position if the face could not be found reliably
+        tracked_rect = cv::Rect(search_rect.tl() + max_location, face_template.size());
+}
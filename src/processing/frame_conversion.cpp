@@ -0,0 +1,189 @@
+#include <include/processing/frame_conversion.h>
+
+#include <opencv2/imgproc.hpp>
+
+#include <helpers/task_pool.h>
+
+//BT.601 limited range to the full range of cv::cvtColor's YCrCb: luma 16..235 and chroma 16..240 span 0..255
+static const float luma_scale = 255.f / 219.f;
+static const float chroma_scale = 255.f / 224.f;
+
+//Rows per task of the conversion between 8 bit frames and the float working format and of the channel selection
+static const int conversion_rows_per_task = 32;
+
+//One pixel in float YCrCb or BGR; the BGR coefficients are those of CV_YCrCb2BGR, which together with the range
+//expansion gives the coefficients of CV_YUV2BGR_YUYV and CV_YUV2BGR_NV12, just without rounding and saturation
+template<bool to_ycrcb>
+static inline cv::Vec3f convert_pixel(const uchar y, const uchar u, const uchar v) {
+    const float luma = (y - 16) * luma_scale;
+    const float cb = (u - 128) * chroma_scale;
+    const float cr = (v - 128) * chroma_scale;
+    if(to_ycrcb)
+        return cv::Vec3f(luma, cr + 128.f, cb + 128.f);
+    return cv::Vec3f(luma + 1.773f * cb, luma - .714f * cr - .344f * cb, luma + 1.403f * cr);
+}
+
+template<bool to_ycrcb>
+static void convert_yuyv_strip(const cv::Mat& frame, cv::Mat_<cv::Vec3f>& frame_float, const cv::Rect& strip) {
+    for(int row = strip.y; row < strip.y + strip.height; ++row) {
+        const uchar* yuyv = frame.ptr<uchar>(row);
+        cv::Vec3f* output = frame_float[row];
+        for(int col = strip.x; col < strip.x + strip.width; ++col) {
+            const uchar* pair = yuyv + (col & ~1) * 2;
+            output[col] = convert_pixel<to_ycrcb>(yuyv[col * 2], pair[1], pair[3]);
+        }
+    }
+}
+
+template<bool to_ycrcb>
+static void convert_nv12_strip(const cv::Mat& frame, cv::Mat_<cv::Vec3f>& frame_float, const cv::Rect& strip) {
+    for(int row = strip.y; row < strip.y + strip.height; ++row) {
+        const uchar* luma = frame.ptr<uchar>(row);
+        const uchar* chroma = frame.ptr<uchar>(frame_float.rows + row / 2);
+        cv::Vec3f* output = frame_float[row];
+        for(int col = strip.x; col < strip.x + strip.width; ++col)
+            output[col] = convert_pixel<to_ycrcb>(luma[col], chroma[col & ~1], chroma[col | 1]);
+    }
+}
+
+//An empty matrix whose data will be created by allocator
+static cv::Mat allocated_by(cv::MatAllocator* allocator) {
+    cv::Mat matrix;
+    matrix.allocator = allocator;
+    return matrix;
+}
+
+//The regions within the frame, cut into strips of conversion_rows_per_task rows
+static std::vector<cv::Rect> get_strips(const std::vector<cv::Rect>& regions, const cv::Size& frame_size) {
+    std::vector<cv::Rect> strips;
+    for(const cv::Rect& region : regions) {
+        const cv::Rect clipped = region & cv::Rect(cv::Point(0, 0), frame_size);
+        for(int y = clipped.y; y < clipped.y + clipped.height; y += conversion_rows_per_task)
+            strips.emplace_back(clipped.x, y, clipped.width, std::min(conversion_rows_per_task, clipped.br().y - y));
+    }
+    return strips;
+}
+
+void frame_conversion::to_working_format(const cv::Mat& frame, const pixel_format_type pixel_format,
+                                         const int color_convert_forward, const std::vector<cv::Rect>& regions,
+                                         cv::Mat_<cv::Vec3f>& frame_float, cv::MatAllocator* allocator) {
+    //Only BGR and YCrCb can be read from the planes directly
+    const bool to_ycrcb = color_convert_forward == CV_BGR2YCrCb;
+    if(pixel_format != pixel_format_type::BGR && color_convert_forward > 0 && !to_ycrcb) {
+        to_working_format(to_bgr(frame, pixel_format, allocator), pixel_format_type::BGR, color_convert_forward,
+                          regions, frame_float, allocator);
+        return;
+    }
+
+    frame_float.create(pixel_format == pixel_format_type::NV12 ? frame.rows * 2 / 3 : frame.rows, frame.cols);
+    const std::vector<cv::Rect> strips = get_strips(regions, frame_float.size());
+    TaskPool& task_pool = TaskPool::instance();
+    std::vector<cv::Mat> scratch(task_pool.get_n_threads(), allocated_by(allocator));
+    task_pool.parallel_for(static_cast<int>(strips.size()), [&](const int strip_id, const int thread_id) {
+        const cv::Rect& strip = strips[strip_id];
+        if(pixel_format == pixel_format_type::BGR) {
+            //Colour conversion in 8 bit, as the float versions of cv::cvtColor use other ranges for some colour spaces
+            if(color_convert_forward > 0) {
+                cv::cvtColor(frame(strip), scratch[thread_id], color_convert_forward);
+                scratch[thread_id].convertTo(frame_float(strip), CV_32FC3);
+            } else
+                frame(strip).convertTo(frame_float(strip), CV_32FC3);
+        } else if(pixel_format == pixel_format_type::YUYV)
+            to_ycrcb ? convert_yuyv_strip<true>(frame, frame_float, strip) :
+                       convert_yuyv_strip<false>(frame, frame_float, strip);
+        else
+            to_ycrcb ? convert_nv12_strip<true>(frame, frame_float, strip) :
+                       convert_nv12_strip<false>(frame, frame_float, strip);
+    });
+}
+
+void frame_conversion::to_output_format(const cv::Mat_<cv::Vec3f>& frame_float, const std::vector<cv::Rect>& regions,
+                                        const int color_convert_backward, const pixel_format_type pixel_format,
+                                        cv::Mat& frame, cv::MatAllocator* allocator) {
+    frame = to_bgr(frame, pixel_format, allocator);
+    const std::vector<cv::Rect> strips = get_strips(regions, frame.size());
+    TaskPool& task_pool = TaskPool::instance();
+    std::vector<cv::Mat> scratch(task_pool.get_n_threads(), allocated_by(allocator));
+    task_pool.parallel_for(static_cast<int>(strips.size()), [&](const int strip_id, const int thread_id) {
+        const cv::Rect& strip = strips[strip_id];
+        if(color_convert_backward > 0) {
+            frame_float(strip).convertTo(scratch[thread_id], CV_8UC3);
+            cv::cvtColor(scratch[thread_id], frame(strip), color_convert_backward);
+        } else
+            frame_float(strip).convertTo(frame(strip), CV_8UC3);
+    });
+}
+
+cv::Mat frame_conversion::to_bgr(const cv::Mat& frame, const pixel_format_type pixel_format,
+                                 cv::MatAllocator* allocator) {
+    cv::Mat bgr_frame = allocated_by(allocator);
+    if(pixel_format == pixel_format_type::YUYV)
+        cv::cvtColor(frame, bgr_frame, CV_YUV2BGR_YUYV);
+    else if(pixel_format == pixel_format_type::NV12)
+        cv::cvtColor(frame, bgr_frame, CV_YUV2BGR_NV12);
+    else
+        bgr_frame = frame;
+    return bgr_frame;
+}
+
+cv::Mat frame_conversion::get_luma(const cv::Mat& frame, const pixel_format_type pixel_format) {
+    cv::Mat luma;
+    if(pixel_format == pixel_format_type::YUYV)
+        cv::extractChannel(frame, luma, 0);
+    else if(pixel_format == pixel_format_type::NV12)
+        luma = frame.rowRange(0, frame.rows * 2 / 3);
+    else
+        cv::cvtColor(frame, luma, CV_BGR2GRAY);
+    return luma;
+}
+
+cv::Mat frame_conversion::take_layer_channels(cv::Mat_<cv::Vec3f> region, const std::vector<int>& layer_channels,
+                                              cv::MatAllocator* allocator) {
+    const int n_channels = static_cast<int>(layer_channels.size());
+    cv::Mat taken;
+    taken.allocator = allocator;
+    if(n_channels == region.channels()) { //All channels, in frame order
+        region.copyTo(taken);
+        region.setTo(0);
+        return taken;
+    }
+
+    taken.create(region.size(), CV_32FC(n_channels));
+    const int n_tasks = (region.rows + conversion_rows_per_task - 1) / conversion_rows_per_task;
+    TaskPool::instance().parallel_for(n_tasks, [&](const int task_id, const int) {
+        const int end = std::min((task_id + 1) * conversion_rows_per_task, region.rows);
+        for(int row = task_id * conversion_rows_per_task; row < end; ++row) {
+            cv::Vec3f* input = region[row];
+            float* output = taken.ptr<float>(row);
+            for(int col = 0; col < region.cols; ++col) {
+                for(int channel_id = 0; channel_id < n_channels; ++channel_id) {
+                    output[col * n_channels + channel_id] = input[col][layer_channels[channel_id]];
+                    input[col][layer_channels[channel_id]] = 0.f;
+                }
+            }
+        }
+    });
+    return taken;
+}
+
+void frame_conversion::add_layer_channels(const cv::Mat& reconstructed, const std::vector<int>& layer_channels,
+                                          cv::Mat_<cv::Vec3f> region) {
+    const int n_channels = static_cast<int>(layer_channels.size());
+    if(n_channels == region.channels()) {
+        region += reconstructed;
+        return;
+    }
+
+    const int n_tasks = (region.rows + conversion_rows_per_task - 1) / conversion_rows_per_task;
+    TaskPool::instance().parallel_for(n_tasks, [&](const int task_id, const int) {
+        const int end = std::min((task_id + 1) * conversion_rows_per_task, region.rows);
+        for(int row = task_id * conversion_rows_per_task; row < end; ++row) {
+            const float* input = reconstructed.ptr<float>(row);
+            cv::Vec3f* output = region[row];
+            for(int col = 0; col < region.cols; ++col) {
+                for(int channel_id = 0; channel_id < n_channels; ++channel_id)
+                    output[col][layer_channels[channel_id]] += input[col * n_channels + channel_id];
+            }
+        }
+    });
+}
@@ -0,0 +1,101 @@
+#include <include/processing/magnification.h>
+
+#include <iostream>
+#include <memory>
+
+#include <include/processing/frame_conversion.h>
+#include <include/processing/spatial_filter.h>
+#include <include/processing/temporal_filter.h>
+
+void magnification::magnify_frame(parameter_store& params, DataContainer& data_container) {
+    if(params.spatial_filter == spatial_filter_type::NONE)
+        return;
+
+    spatial_filter::spatial_decomp(params, data_container);
+    if(params.spatial_filter == spatial_filter_type::RIESZ)
+        temporal_filter::riesz_filter(params, data_container);
+    else if(params.temporal_filter == temporal_filter_type::IDEAL)
+        temporal_filter::ideal_filter(params, data_container);
+    else if(params.temporal_filter == temporal_filter_type::IIR)
+        temporal_filter::iir_filter(params, data_container);
+    spatial_filter::spatial_comp(params, data_container);
+}
+
+int magnification::magnify_video_offline(parameter_store& params, frame_source source, std::function<void()> rewind,
+                                         frame_sink sink, HeartbeatAnalyzer* analyzer) {
+    //The amplified output replaces the history; at up to alpha times the input, it would saturate INT16 samples
+    const bool int16_history = params.temporal_buffer_precision == temporal_buffer_precision_type::INT16;
+    if(int16_history)
+        std::cerr << "Warning: The offline filter keeps its amplified output in the history, using half precision "
+                     "instead of int16" << std::endl;
+
+    //Each region keeps its history in a container of its own
+    std::vector<parameter_store> region_params;
+    std::vector<std::unique_ptr<DataContainer>> data_containers;
+    for(const cv::Rect& region : get_processing_regions(params)) {
+        region_params.push_back(get_region_params(params, region));
+        region_params.back().offline_filter = true;
+        if(int16_history)
+            region_params.back().temporal_buffer_precision = temporal_buffer_precision_type::HALF;
+        data_containers.emplace_back(new DataContainer(region_params.back()));
+    }
+    const std::vector<cv::Rect> roi_rects = get_roi_rects(params);
+    const std::vector<cv::Rect> converted_regions = get_converted_regions(params);
+    cv::Mat frame;
+    cv::Mat_<cv::Vec3f> frame_float;
+    std::vector<cv::Mat> layers;
+
+    //First pass: Fill the temporal buffers with the decomposed regions of every frame
+    int n_frames = 0;
+    while(n_frames < params.n_buffered_frames && source(frame)) {
+        frame_conversion::to_working_format(frame, pixel_format_type::BGR, params.color_convert_forward,
+                                            converted_regions, frame_float);
+        for(size_t region_id = 0; region_id < data_containers.size(); ++region_id) {
+            DataContainer& data_container = *data_containers[region_id];
+            const parameter_store& current_params = region_params[region_id];
+            data_container.push_frame(frame_float, region_params[region_id]);
+            spatial_filter::build_pyramid(frame_conversion::take_layer_channels(frame_float(current_params.roi_rect),
+                                                                                current_params.layer_channels),
+                                          params.n_layers, layers);
+            for(int layer_id = 0; layer_id < params.n_layers; ++layer_id)
+                data_container.put_layer(layer_id, layers[layer_id]);
+            data_container.advance_frame();
+        }
+        ++n_frames;
+    }
+
+    for(size_t region_id = 0; region_id < data_containers.size(); ++region_id)
+        temporal_filter::ideal_filter_offline(region_params[region_id], *data_containers[region_id], n_frames);
+
+    //Second pass: Replace the buffered layers with their filtered versions; the others are decomposed again
+    rewind();
+    for(int frame_id = 0; frame_id < n_frames && source(frame); ++frame_id) {
+        frame_conversion::to_working_format(frame, pixel_format_type::BGR, params.color_convert_forward,
+                                            converted_regions, frame_float);
+        for(size_t region_id = 0; region_id < data_containers.size(); ++region_id) {
+            const parameter_store& current_params = region_params[region_id];
+            const cv::Rect& region = current_params.roi_rect;
+            spatial_filter::build_pyramid(frame_conversion::take_layer_channels(frame_float(region),
+                                                                                current_params.layer_channels),
+                                          params.n_layers, layers);
+            for(int layer_id = 0; layer_id < params.n_layers; ++layer_id) {
+                cv::Mat buffered_layer = data_containers[region_id]->get_buffered_layer(layer_id, frame_id);
+                if(!buffered_layer.empty())
+                    layers[layer_id] = buffered_layer;
+            }
+            frame_conversion::add_layer_channels(spatial_filter::collapse_pyramid(layers), current_params.layer_channels,
+                                                 frame_float(region));
+        }
+        if(params.analyze_heartbeat && analyzer) { //Of the magnified frame, like the frame by frame processing
+            std::vector<cv::Scalar> roi_means;
+            for(const cv::Rect& roi_rect : roi_rects)
+                roi_means.push_back(cv::mean(frame_float(roi_rect)));
+            analyzer->push(roi_means, params);
+        }
+
+        frame_conversion::to_output_format(frame_float, converted_regions, params.color_convert_backward,
+                                           pixel_format_type::BGR, frame);
+        sink(frame);
+    }
+    return n_frames;
+}
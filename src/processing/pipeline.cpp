@@ -0,0 +1,161 @@
+#include <include/processing/pipeline.h>
+
+#include <memory>
+
+#include <helpers/data_container.h>
+#include <helpers/fftw_planner.h>
+#include <include/processing/frame_conversion.h>
+#include <include/processing/spatial_filter.h>
+#include <include/processing/temporal_filter.h>
+
+FramePipeline::FramePipeline(const size_t queue_depth, HeartbeatAnalyzer* _analyzer) :
+        decoded_frames(queue_depth), decomposed_frames(queue_depth),
+        filtered_frames(queue_depth), reconstructed_frames(queue_depth),
+        analyzer(_analyzer), buffer_pool(new BufferPool), n_temporal_allocations(0) { }
+
+FramePipeline::~FramePipeline() {
+    buffer_pool->release();
+}
+
+void FramePipeline::run(source_stage source, sink_stage sink) {
+    std::thread source_thread([this, &source]() {
+        bool end_of_stream = false;
+        while(!end_of_stream) {
+            frame_packet packet;
+            end_of_stream = !source(packet);
+            packet.end_of_stream = end_of_stream;
+            decoded_frames.push(packet);
+        }
+    });
+    std::thread decomposition_thread(&FramePipeline::decomposition_stage, this);
+    std::thread temporal_thread(&FramePipeline::temporal_stage, this);
+    std::thread reconstruction_thread(&FramePipeline::reconstruction_stage, this);
+
+    frame_packet packet;
+    for(reconstructed_frames.pop(packet); !packet.end_of_stream; reconstructed_frames.pop(packet))
+        sink(packet);
+
+    source_thread.join();
+    decomposition_thread.join();
+    temporal_thread.join();
+    reconstruction_thread.join();
+}
+
+size_t FramePipeline::get_n_allocations() const noexcept {
+    return buffer_pool->get_n_allocations() + n_temporal_allocations;
+}
+
+std::vector<queue_status> FramePipeline::get_queue_status() const {
+    return std::vector<queue_status> {
+            {"decoded", decoded_frames.depth(), decoded_frames.occupancy(), decoded_frames.get_max_occupancy()},
+            {"decomposed", decomposed_frames.depth(), decomposed_frames.occupancy(), decomposed_frames.get_max_occupancy()},
+            {"filtered", filtered_frames.depth(), filtered_frames.occupancy(), filtered_frames.get_max_occupancy()},
+            {"reconstructed", reconstructed_frames.depth(), reconstructed_frames.occupancy(),
+                    reconstructed_frames.get_max_occupancy()}
+    };
+}
+
+//Colour conversion and float conversion of the ROIs, spatial decomposition of the active channels of each region
+void FramePipeline::decomposition_stage() {
+    frame_packet packet;
+    for(decoded_frames.pop(packet); !packet.end_of_stream; decoded_frames.pop(packet)) {
+        parameter_store& params = packet.params;
+        buffer_pool->set_recycling(params.pool_buffers);
+        packet.frame_float = buffer_pool->matrix<cv::Vec3f>();
+        frame_conversion::to_working_format(packet.frame, packet.pixel_format, params.color_convert_forward,
+                                            get_converted_regions(params), packet.frame_float, buffer_pool);
+
+        packet.regions = get_processing_regions(params);
+        if(params.spatial_filter != spatial_filter_type::NONE) {
+            packet.layers.resize(packet.regions.size());
+            for(size_t region_id = 0; region_id < packet.regions.size(); ++region_id) {
+                const cv::Rect& region = packet.regions[region_id];
+                spatial_filter::build_pyramid(frame_conversion::take_layer_channels(
+                                                      packet.frame_float(region),
+                                                      get_region_params(params, region).layer_channels, buffer_pool),
+                                              params.n_layers, packet.layers[region_id], buffer_pool);
+            }
+        }
+        decomposed_frames.push(packet);
+    }
+    decomposed_frames.push(packet);
+}
+
+//Temporal filtering; this is the only stage with state spanning several frames, which is kept per region
+void FramePipeline::temporal_stage() {
+    std::vector<std::unique_ptr<DataContainer>> data_containers;
+    size_t n_earlier_allocations = 0; //Of the containers of earlier ROIs
+    frame_packet packet;
+    for(decomposed_frames.pop(packet); !packet.end_of_stream; decomposed_frames.pop(packet)) {
+        if(data_containers.size() != packet.regions.size()) { //ROIs added or removed, their histories do not match
+            for(const std::unique_ptr<DataContainer>& data_container : data_containers)
+                n_earlier_allocations += data_container->get_buffer_pool().get_n_allocations();
+            data_containers.clear();
+            for(const cv::Rect& region : packet.regions) {
+                parameter_store region_params = get_region_params(packet.params, region);
+                data_containers.emplace_back(new DataContainer(region_params));
+            }
+        }
+
+        for(size_t region_id = 0; region_id < packet.regions.size(); ++region_id) {
+            parameter_store params = get_region_params(packet.params, packet.regions[region_id]);
+            DataContainer& data_container = *data_containers[region_id];
+            data_container.push_frame(packet.frame_float, params);
+
+            if(params.spatial_filter != spatial_filter_type::NONE) {
+                std::vector<cv::Mat>& layers = packet.layers[region_id];
+                for(int layer_id = 0; layer_id < params.n_layers; ++layer_id)
+                    data_container.put_layer(layer_id, layers[layer_id]);
+
+                if(params.spatial_filter == spatial_filter_type::RIESZ)
+                    temporal_filter::riesz_filter(params, data_container);
+                else if(params.temporal_filter == temporal_filter_type::IDEAL)
+                    temporal_filter::ideal_filter(params, data_container);
+                else if(params.temporal_filter == temporal_filter_type::IIR)
+                    temporal_filter::iir_filter(params, data_container);
+
+                for(int layer_id = 0; layer_id < params.n_layers; ++layer_id)
+                    layers[layer_id] = data_container.get_layer(layer_id);
+            }
+
+            data_container.advance_frame();
+        }
+        FFTWPlanner::instance().release_unused(); //All regions have requested their plans of this frame
+
+        size_t n_allocations = n_earlier_allocations;
+        for(const std::unique_ptr<DataContainer>& data_container : data_containers)
+            n_allocations += data_container->get_buffer_pool().get_n_allocations();
+        n_temporal_allocations = n_allocations;
+        filtered_frames.push(packet);
+    }
+    filtered_frames.push(packet);
+}
+
+//Spatial reconstruction, ROI means for the analyzer and conversion of the ROIs back to the 8 bit output colour space
+void FramePipeline::reconstruction_stage() {
+    frame_packet packet;
+    for(filtered_frames.pop(packet); !packet.end_of_stream; filtered_frames.pop(packet)) {
+        parameter_store& params = packet.params;
+        if(params.spatial_filter != spatial_filter_type::NONE) {
+            for(size_t region_id = 0; region_id < packet.regions.size(); ++region_id) {
+                const cv::Rect& region = packet.regions[region_id];
+                frame_conversion::add_layer_channels(spatial_filter::collapse_pyramid(packet.layers[region_id],
+                                                                                      buffer_pool),
+                                                     get_region_params(params, region).layer_channels,
+                                                     packet.frame_float(region));
+            }
+        }
+        if(params.analyze_heartbeat && analyzer) { //Of the magnified frame, like the sequential processing
+            std::vector<cv::Scalar> roi_means;
+            for(const cv::Rect& roi_rect : get_roi_rects(params))
+                roi_means.push_back(cv::mean(packet.frame_float(roi_rect)));
+            analyzer->push(roi_means, params);
+        }
+        frame_conversion::to_output_format(packet.frame_float, get_converted_regions(params),
+                                           params.color_convert_backward, packet.pixel_format, packet.frame,
+                                           buffer_pool);
+        buffer_pool->release_unused(); //Once per frame, the sizes of the frames in flight stay requested
+        reconstructed_frames.push(packet);
+    }
+    reconstructed_frames.push(packet);
+}
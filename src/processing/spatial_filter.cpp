@@ -1,22 +1,119 @@
 #include <include/processing/spatial_filter.h>
 
+#include <helpers/task_pool.h>
+
+//An empty matrix whose data will be created by allocator
+inline cv::Mat allocated_by(cv::MatAllocator* allocator) {
+    cv::Mat matrix;
+    matrix.allocator = allocator;
+    return matrix;
+}
+
+//Output rows per strip of the tiled pyramid operations: about strip_floats values, but at least min_strip_rows rows so
+//that the overlap of neighbouring strips stays small
+static int get_strip_rows(const int cols, const int channels) noexcept {
+    const int strip_floats = 1 << 16;
+    const int min_strip_rows = 16;
+    return std::max(strip_floats / std::max(cols * channels, 1), min_strip_rows);
+}
+
+/**
+* cv::pyrDown split into horizontal strips that run as tasks: Each strip of output rows [y0, y1) is computed from the
+* input rows [2*y0-2, 2*y1+2) (clipped to the image), i.e. the 5-tap kernel's halo of two rows on either side, so
+* OpenCV's border handling only affects halo rows that are dropped. The result is identical to cv::pyrDown.
+*/
+static void pyr_down_tiled(const cv::Mat& source, cv::Mat& destination, cv::MatAllocator* allocator) {
+    destination.create((source.rows + 1) / 2, (source.cols + 1) / 2, source.type());
+    const int strip_rows = get_strip_rows(destination.cols, source.channels());
+    const int n_strips = (destination.rows + strip_rows - 1) / strip_rows;
+    std::vector<cv::Mat> scratch(TaskPool::instance().get_n_threads(), allocated_by(allocator));
+    TaskPool::instance().parallel_for(n_strips, [&](const int strip_id, const int thread_id) {
+        const int y0 = strip_id * strip_rows;
+        const int y1 = std::min(destination.rows, y0 + strip_rows);
+        const int source_begin = std::max(0, 2 * y0 - 2); //Even, so the strip keeps the sampling grid
+        const int source_end = std::min(source.rows, 2 * y1 + 2);
+        cv::pyrDown(source.rowRange(source_begin, source_end), scratch[thread_id]);
+        scratch[thread_id].rowRange(y0 - source_begin / 2, y1 - source_begin / 2).copyTo(destination.rowRange(y0, y1));
+    });
+}
+
+/**
+* destination = finer + sign * cv::pyrUp(source, finer.size()), split into horizontal strips that run as tasks: Each
+* strip of source rows [y0, y1) is upsampled with one halo row on either side and only its output rows [2*y0, 2*y1) are
+* kept, which makes the result identical to the serial cv::pyrUp and cv::add or cv::subtract.
+*/
+static void pyr_up_tiled(const cv::Mat& source, const cv::Mat& finer, const int sign, cv::Mat& destination,
+                         cv::MatAllocator* allocator) {
+    destination.create(finer.size(), finer.type());
+    const int strip_rows = std::max(get_strip_rows(finer.cols, finer.channels()) / 2, 1);
+    const int n_strips = (source.rows + strip_rows - 1) / strip_rows;
+    std::vector<cv::Mat> scratch(TaskPool::instance().get_n_threads(), allocated_by(allocator));
+    TaskPool::instance().parallel_for(n_strips, [&](const int strip_id, const int thread_id) {
+        const int y0 = strip_id * strip_rows;
+        const int y1 = std::min(source.rows, y0 + strip_rows);
+        const int source_begin = std::max(0, y0 - 1);
+        const int source_end = std::min(source.rows, y1 + 1);
+        //Only the last strip may have an odd number of output rows, like the whole image
+        const int upsampled_rows = source_end == source.rows ? finer.rows - 2 * source_begin :
+                                   2 * (source_end - source_begin);
+        cv::pyrUp(source.rowRange(source_begin, source_end), scratch[thread_id], cv::Size(finer.cols, upsampled_rows));
+
+        const int row_begin = 2 * y0, row_end = std::min(finer.rows, 2 * y1);
+        const cv::Mat upsampled = scratch[thread_id].rowRange(row_begin - 2 * source_begin, row_end - 2 * source_begin);
+        cv::Mat destination_rows = destination.rowRange(row_begin, row_end);
+        if(sign < 0)
+            cv::subtract(finer.rowRange(row_begin, row_end), upsampled, destination_rows);
+        else
+            cv::add(upsampled, finer.rowRange(row_begin, row_end), destination_rows);
+    });
+}
+
 void spatial_filter::spatial_decomp(parameter_store& params, DataContainer& data_container) {
-    cv::Mat last_layer = data_container.get_frame_roi();
-    cv::Mat scaled_down = last_layer, scaled_up;
-    for (int layer_id = 0; layer_id < params.n_layers-1; ++layer_id) {
-        cv::pyrDown(scaled_down, scaled_down);
-        cv::pyrUp(scaled_down, scaled_up);
-        data_container.put_layer(layer_id, last_layer-scaled_up);
+    std::vector<cv::Mat> layers;
+    build_pyramid(data_container.get_frame_roi(), params.n_layers, layers, &data_container.get_buffer_pool());
+    for (int layer_id = 0; layer_id < params.n_layers; ++layer_id)
+        data_container.put_layer(layer_id, layers[layer_id]);
+}
+
+void spatial_filter::spatial_comp(parameter_store& params, DataContainer& data_container) {
+    std::vector<cv::Mat> layers(params.n_layers);
+    for(int layer_id = 0; layer_id < params.n_layers; ++layer_id)
+        layers[layer_id] = data_container.get_layer(layer_id);
+    data_container.insert_reconstructed_layer_roi(collapse_pyramid(layers, &data_container.get_buffer_pool()));
+}
+
+void spatial_filter::build_pyramid(const cv::Mat& roi, const int n_layers, std::vector<cv::Mat>& layers,
+                                   cv::MatAllocator* allocator) {
+    layers.resize(n_layers);
+    cv::Mat last_layer = roi;
+    for (int layer_id = 0; layer_id < n_layers-1; ++layer_id) {
+        cv::Mat scaled_down = allocated_by(allocator);
+        pyr_down_tiled(last_layer, scaled_down, allocator);
+        layers[layer_id] = allocated_by(allocator);
+        pyr_up_tiled(scaled_down, last_layer, -1, layers[layer_id], allocator);
         last_layer = scaled_down;
     }
-    data_container.put_layer(params.n_layers-1, last_layer);
+    layers[n_layers-1] = last_layer;
 }
 
-void spatial_filter::spatial_comp(parameter_store& params, DataContainer& data_container) {
-    for(int layer_id = 0; layer_id < params.n_layers; ++layer_id) {
-        cv::Mat reconst_layer = data_container.get_layer(layer_id);
-        for (int inner_layer_id = layer_id; inner_layer_id > 0; --inner_layer_id)
-            cv::pyrUp(reconst_layer, reconst_layer);
-        data_container.insert_reconstructed_layer_roi(reconst_layer);
+//Cascaded collapse: Upsample the coarsest layer, add the next finer one and repeat, i.e. one pyrUp per layer; each
+//level is upsampled strip by strip and the finer layer is added to each strip right away
+cv::Mat spatial_filter::collapse_pyramid(const std::vector<cv::Mat>& layers, cv::MatAllocator* allocator) {
+    cv::Mat reconstructed = layers.back();
+    for (int layer_id = static_cast<int>(layers.size())-2; layer_id >= 0; --layer_id) {
+        cv::Mat scaled_up = allocated_by(allocator);
+        pyr_up_tiled(reconstructed, layers[layer_id], 1, scaled_up, allocator);
+        reconstructed = scaled_up;
     }
+    return reconstructed;
+}
+
+void spatial_filter::riesz_transform(const cv::Mat& layer, cv::Mat& riesz_x, cv::Mat& riesz_y,
+                                     cv::MatAllocator* allocator) {
+    static const cv::Mat_<float> kernel_x = (cv::Mat_<float>(1, 3) << .5f, 0.f, -.5f);
+    static const cv::Mat_<float> kernel_y = kernel_x.t();
+    riesz_x = allocated_by(allocator);
+    riesz_y = allocated_by(allocator);
+    cv::filter2D(layer, riesz_x, -1, kernel_x, cv::Point(-1, -1), 0, cv::BORDER_REFLECT_101);
+    cv::filter2D(layer, riesz_y, -1, kernel_y, cv::Point(-1, -1), 0, cv::BORDER_REFLECT_101);
 }
@@ -1,68 +1,189 @@
 #include <include/processing/temporal_filter.h>
 
-#include <fftw3.h>
+#include <helpers/fftw_planner.h>
+#include <helpers/task_pool.h>
+#include <include/processing/spatial_filter.h>
 
-class fftw_forward_plans {
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+class sliding_dft_twiddles {
 public:
-    fftw_forward_plans() : plans(0) { }
-
-    void update(DataContainer& data_container, int n_layers, int n_buffered_frames, bool measure) {
-        if(plans.size() != n_layers || plan_buffered_frames != n_buffered_frames) {
-            plans.resize(n_layers);
-            for(int layer_id = 0; layer_id < n_layers; ++layer_id) {
-                fftwf_destroy_plan(plans[layer_id]);
-                plans[layer_id] = fftwf_plan_dft_r2c_1d(
-                        plan_buffered_frames = n_buffered_frames,
-                        data_container.get_input_timeseries(layer_id, 0, 0).ptr<float>(0),
-                        reinterpret_cast<fftwf_complex*>(data_container.get_fftwf_data(layer_id, 0, 0).ptr<float>(0)),
-                        measure ? FFTW_MEASURE : FFTW_ESTIMATE+FFTW_UNALIGNED);
+    sliding_dft_twiddles() : twiddle_buffered_frames(0) { }
+
+    void update(int n_buffered_frames, const cv::Range& band) {
+        if(twiddle_buffered_frames != n_buffered_frames || twiddle_band != band) {
+            twiddle_buffered_frames = n_buffered_frames;
+            twiddle_band = band;
+            twiddles = cv::Mat_<double>(std::max(band.size(), 1), 2 * n_buffered_frames);
+            for(int bin_id = band.start; bin_id < band.end; ++bin_id) {
+                for(int position = 0; position < n_buffered_frames; ++position) {
+                    double angle = 2.0 * CV_PI * bin_id * position / n_buffered_frames;
+                    twiddles(bin_id - band.start, 2 * position) = std::cos(angle);
+                    twiddles(bin_id - band.start, 2 * position + 1) = std::sin(angle);
+                }
             }
         }
     }
 
-    fftwf_plan operator[](const int layer_id) { return plans[layer_id]; }
+    //Interleaved cos/sin of 2*pi*bin*position/n_buffered_frames for all ring buffer positions
+    const double* operator[](const int bin_id) { return twiddles.ptr<double>(bin_id - twiddle_band.start); }
 
 private:
-    int plan_buffered_frames;
-    std::vector<fftwf_plan> plans;
+    int twiddle_buffered_frames;
+    cv::Range twiddle_band;
+    cv::Mat_<double> twiddles;
 };
 
-class fftw_backward_plans {
-public:
-    fftw_backward_plans() : plans(0) { }
-
-    void update(DataContainer& data_container, int n_layers, int n_buffered_frames, bool measure) {
-        if(plans.size() != n_layers || plan_buffered_frames != n_buffered_frames) {
-            plans.resize(n_layers);
-            for(int layer_id = 0; layer_id < n_layers; ++layer_id) {
-                fftwf_destroy_plan(plans[layer_id]);
-                plans[layer_id] = fftwf_plan_dft_c2r_1d(
-                        plan_buffered_frames = n_buffered_frames,
-                        reinterpret_cast<fftwf_complex *>(data_container.get_fftwf_data(layer_id, 0, 0).ptr<float>(0)),
-                        data_container.get_output_timeseries(layer_id, 0, 0).ptr<float>(0),
-                        measure ? FFTW_MEASURE : FFTW_ESTIMATE+FFTW_UNALIGNED);
-            }
+/**
+* Ideal filtering with a sliding DFT: Instead of re-transforming the whole buffer, only the bins within the passband
+* are kept per timeseries and updated with the difference between the newest and the overwritten sample.
+* Only the current output sample is synthesised. The passband is rounded to whole bins, whereas the FFTW engine rounds
+* it in interleaved floats and may keep only the real part of a boundary bin; so the outputs of both engines only
+* match if min_freq and max_freq are multiples of fps/n_buffered_frames.
+*/
+void ideal_filter_sliding_dft(parameter_store& params, DataContainer& data_container) {
+    int n_layers = params.spatial_filter == spatial_filter_type::LAPLACIAN ? params.n_layers : 1;
+    const int n_frames = params.n_buffered_frames;
+
+    cv::Range band(std::max(0, static_cast<int>(params.min_freq / static_cast<float>(params.fps) * n_frames)),
+                   std::min(n_frames / 2 + 1, static_cast<int>(params.max_freq / static_cast<float>(params.fps) * n_frames)));
+    if(band.start >= band.end)
+        band = cv::Range(0, 0);
+
+    static sliding_dft_twiddles twiddles;
+    twiddles.update(n_frames, band);
+    const bool recalculate = data_container.update_sliding_dft_band(band);
+    const int position = (data_container.get_n_used_frames() - 1) % n_frames;
+
+    //Tasks of rows_per_task timeseries rows (timeseries_id*n_channels+channel_id) each
+    const int rows_per_task = 64;
+    TaskPool& task_pool = TaskPool::instance();
+    std::vector<std::vector<float>> inputs(task_pool.get_n_threads(), std::vector<float>(recalculate ? n_frames : 0));
+
+    for (int layer_id = 0; layer_id < n_layers; ++layer_id) {
+        float layer_lambda = sqrtf(powf(fit_to_layer(params.roi_rect.size(), layer_id).width, 2.f)
+                                   + powf(fit_to_layer(params.roi_rect.size(), layer_id).height, 2.f));
+        float calculated_alpha = layer_lambda / params.lambda_c * (1 + params.alpha);
+        double gain = calculated_alpha < params.alpha ? calculated_alpha : params.alpha;
+        int n_timeseries = params.spatial_filter == spatial_filter_type::LAPLACIAN ?
+                           fit_to_layer(params.roi_rect.size(), layer_id).area() :
+                           fit_to_layer(params.roi_rect.size(), params.n_layers - 1).area();
+
+        const int block_size = data_container.get_timeseries_block_size(layer_id);
+        data_container.prefetch_timeseries(layer_id, 0, block_size);
+        for (int block_start = 0; block_start < n_timeseries; block_start += block_size) {
+            const int block_end = std::min(n_timeseries, block_start + block_size);
+            data_container.prefetch_timeseries(layer_id, block_end, block_size);
+
+            const int first_row = block_start * params.n_channels;
+            const int end_row = block_end * params.n_channels;
+            task_pool.parallel_for((end_row - first_row + rows_per_task - 1) / rows_per_task,
+                                   [&](const int task_id, const int thread_id) {
+                std::vector<float>& input = inputs[thread_id];
+                const int task_end_row = std::min(end_row, first_row + (task_id + 1) * rows_per_task);
+                for (int row = first_row + task_id * rows_per_task; row < task_end_row; ++row) {
+                    const int timeseries_id = row / params.n_channels;
+                    const int channel_id = row % params.n_channels;
+                    const float current_input = data_container.get_current_input_sample(layer_id, timeseries_id,
+                                                                                        channel_id);
+
+                    //The bins of inactive channels are kept up to date as well, so that they are valid once the
+                    //channel is activated again
+                    double* bins = data_container.get_sliding_dft_bins(layer_id, timeseries_id,
+                                                                       channel_id).ptr<double>(0);
+                    if(recalculate) { //Passband or buffers changed: Calculate the bins from the whole buffer once
+                        data_container.widen_input_timeseries(layer_id, timeseries_id, channel_id, input.data());
+                        for(int bin_id = band.start; bin_id < band.end; ++bin_id) {
+                            const double* twiddle = twiddles[bin_id];
+                            double real = 0.0, imaginary = 0.0;
+                            for(int frame_id = 0; frame_id < n_frames; ++frame_id) {
+                                real += input[frame_id] * twiddle[2 * frame_id];
+                                imaginary -= input[frame_id] * twiddle[2 * frame_id + 1];
+                            }
+                            bins[2 * (bin_id - band.start)] = real;
+                            bins[2 * (bin_id - band.start) + 1] = imaginary;
+                        }
+                    } else {
+                        double delta = data_container.get_sample_delta(layer_id, timeseries_id, channel_id);
+                        for(int bin_id = band.start; bin_id < band.end; ++bin_id) {
+                            const double* twiddle = twiddles[bin_id];
+                            bins[2 * (bin_id - band.start)] += delta * twiddle[2 * position];
+                            bins[2 * (bin_id - band.start) + 1] -= delta * twiddle[2 * position + 1];
+                        }
+                    }
+                    if (!params.active_channels[channel_id]) {
+                        data_container.put_current_output_sample(layer_id, timeseries_id, channel_id, current_input);
+                        continue;
+                    }
+
+                    //Inverse DFT at the current position only; all bins but DC and Nyquist also stand for their mirror
+                    double bandpassed = 0.0;
+                    for(int bin_id = band.start; bin_id < band.end; ++bin_id) {
+                        const double* twiddle = twiddles[bin_id];
+                        double weight = (bin_id == 0 || 2 * bin_id == n_frames) ? 1.0 : 2.0;
+                        bandpassed += weight * (bins[2 * (bin_id - band.start)] * twiddle[2 * position] -
+                                                bins[2 * (bin_id - band.start) + 1] * twiddle[2 * position + 1]);
+                    }
+                    data_container.put_current_output_sample(layer_id, timeseries_id, channel_id,
+                            static_cast<float>(current_input + (gain - 1.0) * bandpassed / n_frames));
+                }
+            });
+
+            data_container.write_back_timeseries(layer_id, block_start, block_end - block_start);
         }
     }
+}
 
-    fftwf_plan operator[](const int layer_id) { return plans[layer_id]; }
-
-private:
-    int plan_buffered_frames;
-    std::vector<fftwf_plan> plans;
+//Per-thread scratch buffers of the ideal filter
+struct ideal_filter_scratch {
+    std::vector<float> input;
+    std::vector<float> output;
+    std::vector<float> spectra;
 };
 
 void temporal_filter::ideal_filter(parameter_store& params, DataContainer& data_container) {
+    if(params.ideal_filter_engine == ideal_filter_engine_type::SLIDING_DFT) {
+        ideal_filter_sliding_dft(params, data_container);
+        return;
+    }
+
     int n_layers = params.spatial_filter == spatial_filter_type::LAPLACIAN ? params.n_layers : 1;
 
-    static fftw_forward_plans forward_plans;
-    forward_plans.update(data_container, n_layers,
-                         std::min(params.n_buffered_frames, data_container.get_n_used_frames()),
-                         data_container.get_n_used_frames() >= params.n_buffered_frames);
-    static fftw_backward_plans backward_plans;
-    backward_plans.update(data_container, n_layers,
-                          std::min(params.n_buffered_frames, data_container.get_n_used_frames()),
-                          data_container.get_n_used_frames() >= params.n_buffered_frames);
+    //One pair of batched plans serves all layers; measured plans replace the estimates once they are ready. The plans
+    //always span the whole buffer, whose samples are zero until the warm-up has filled it, so that their keys stay the
+    //same from the first frame on. Batches whose plans are still missing repeat their last output.
+    const int stride = data_container.get_timeseries_stride();
+    const int dist = data_container.get_timeseries_dist();
+    const int batch_size = data_container.get_timeseries_batch_size();
+    const int n_spectrum_floats = 2 * (params.n_buffered_frames / 2 + 1);
+    const fftwf_plan forward_plan = FFTWPlanner::instance().get({true, params.n_buffered_frames, stride, batch_size,
+                                                                 dist});
+    const fftwf_plan backward_plan = FFTWPlanner::instance().get({false, params.n_buffered_frames, stride, batch_size,
+                                                                  dist});
+
+    const int position = (data_container.get_n_used_frames() - 1) % params.n_buffered_frames;
+    const bool compact = data_container.has_compact_timeseries();
+
+    //Compact timeseries are widened into per-thread scratch buffers, only the current output sample is kept
+    TaskPool& task_pool = TaskPool::instance();
+    std::vector<ideal_filter_scratch> scratch(task_pool.get_n_threads());
+    for(ideal_filter_scratch& thread_scratch : scratch) {
+        thread_scratch.input.resize(compact ? batch_size * params.n_buffered_frames : 0);
+        thread_scratch.output.resize(compact ? batch_size * params.n_buffered_frames : 0);
+        thread_scratch.spectra.resize(batch_size * n_spectrum_floats);
+    }
+
+    //Passband in interleaved spectrum floats
+    cv::Range band(0, 0);
+    if(params.min_freq < params.max_freq)
+        band = cv::Range(std::min(n_spectrum_floats, static_cast<int>(2.f * (params.min_freq / static_cast<float>(params.fps)) *
+                                                                      static_cast<float>(params.n_buffered_frames))),
+                         std::min(n_spectrum_floats, static_cast<int>(2.f * (params.max_freq / static_cast<float>(params.fps)) *
+                                                                      static_cast<float>(params.n_buffered_frames))));
 
     for (int layer_id = 0; layer_id < n_layers; ++layer_id) {
         float layer_lambda = sqrtf(powf(fit_to_layer(params.roi_rect.size(), layer_id).width, 2.f)
@@ -72,60 +193,527 @@ void temporal_filter::ideal_filter(parameter_store& params, DataContainer& data_
                            fit_to_layer(params.roi_rect.size(), layer_id).area() :
                            fit_to_layer(params.roi_rect.size(), params.n_layers - 1).area();
 
-#pragma omp parallel for collapse(2) shared(params, data_container, forward_plans, backward_plans)
-        for (int timeseries_id = 0; timeseries_id < n_timeseries; ++timeseries_id) {
-            for (int channel_id = 0; channel_id < params.n_channels; ++channel_id) {
-                if (!params.active_channels[channel_id]) {
-                    std::memcpy(
-                            data_container.get_output_timeseries(layer_id, timeseries_id, channel_id).ptr<float>(0),
-                            data_container.get_input_timeseries(layer_id, timeseries_id, channel_id).ptr<float>(0),
-                            params.n_buffered_frames * sizeof(float));
-                    continue;
+        //The 1/N normalisation of the inverse transform is applied to the spectrum, together with the passband gain
+        const float normalisation = 1.f / static_cast<float>(params.n_buffered_frames);
+        const float band_factor = (calculated_alpha < params.alpha ? calculated_alpha : params.alpha) * normalisation;
+
+        const int block_size = data_container.get_timeseries_block_size(layer_id);
+        data_container.prefetch_timeseries(layer_id, 0, block_size);
+        for (int block_start = 0; block_start < n_timeseries; block_start += block_size) {
+            const int block_end = std::min(n_timeseries, block_start + block_size);
+            data_container.prefetch_timeseries(layer_id, block_end, block_size);
+
+            //Blocks hold whole batches except at the end of a layer, whose last batch gets plans of its own
+            const int first_row = block_start * params.n_channels;
+            const int end_row = block_end * params.n_channels;
+            const int n_batches = (end_row - first_row + batch_size - 1) / batch_size;
+            const int tail_size = (end_row - first_row) % batch_size;
+            const fftwf_plan tail_forward_plan = tail_size == 0 ? nullptr :
+                    FFTWPlanner::instance().get({true, params.n_buffered_frames, stride, tail_size, dist});
+            const fftwf_plan tail_backward_plan = tail_size == 0 ? nullptr :
+                    FFTWPlanner::instance().get({false, params.n_buffered_frames, stride, tail_size, dist});
+
+            //One batch per task; the ranges of consecutive batches each thread starts with are contiguous
+            task_pool.parallel_for(n_batches, [&](const int batch_id, const int thread_id) {
+                const int batch_row = first_row + batch_id * batch_size;
+                const int n_rows = std::min(batch_size, end_row - batch_row);
+                const bool tail = n_rows < batch_size;
+                const bool planned = tail ? tail_forward_plan && tail_backward_plan : forward_plan && backward_plan;
+
+                float* input = scratch[thread_id].input.data();
+                float* output = scratch[thread_id].output.data();
+                if(compact) {
+                    for(int row = 0; row < n_rows; ++row)
+                        data_container.widen_input_timeseries(layer_id, (batch_row + row) / params.n_channels,
+                                                              (batch_row + row) % params.n_channels,
+                                                              input + row * params.n_buffered_frames);
+                } else {
+                    input = data_container.get_input_timeseries(layer_id, batch_row / params.n_channels,
+                                                                batch_row % params.n_channels).ptr<float>(0);
+                    output = data_container.get_output_timeseries(layer_id, batch_row / params.n_channels,
+                                                                  batch_row % params.n_channels).ptr<float>(0);
                 }
 
-                fftwf_execute_dft_r2c(forward_plans[layer_id],
-                        data_container.get_input_timeseries(layer_id, timeseries_id, channel_id).ptr<float>(0),
-                        reinterpret_cast<fftwf_complex*>(data_container.get_fftwf_data(layer_id, timeseries_id,
-                                                                                        channel_id).ptr<float>(0)));
-
-                if(params.min_freq < params.max_freq)
-                    data_container.get_fftwf_data(layer_id, timeseries_id, channel_id).colRange(
-                            static_cast<int>(2.f * (params.min_freq / static_cast<float>(params.fps)) *
-                                             static_cast<float>(params.n_buffered_frames)),
-                            static_cast<int>(2.f * (params.max_freq / static_cast<float>(params.fps)) *
-                                             static_cast<float>(params.n_buffered_frames))
-                    ) *= calculated_alpha < params.alpha ? calculated_alpha : params.alpha;
-
-                fftwf_execute_dft_c2r(backward_plans[layer_id],
-                        reinterpret_cast<fftwf_complex*>(data_container.get_fftwf_data(layer_id, timeseries_id,
-                                                                                        channel_id).ptr<float>(0)),
-                        data_container.get_output_timeseries(layer_id, timeseries_id, channel_id).ptr<float>(0));
-
-                data_container.get_output_timeseries(layer_id, timeseries_id, channel_id)
-                        /= static_cast<float>(std::min(data_container.get_n_used_frames(), params.n_buffered_frames));
-            }
+                if(planned)
+                    fftwf_execute_dft_r2c(tail ? tail_forward_plan : forward_plan, input,
+                                          reinterpret_cast<fftwf_complex*>(scratch[thread_id].spectra.data()));
+
+                for(int row = 0; row < n_rows && planned; ++row) {
+                    if(!params.active_channels[(batch_row + row) % params.n_channels])
+                        continue;
+                    float* spectrum = scratch[thread_id].spectra.data() + row * n_spectrum_floats;
+                    for(int column = 0; column < band.start; ++column)
+                        spectrum[column] *= normalisation;
+                    for(int column = band.start; column < band.end; ++column)
+                        spectrum[column] *= band_factor;
+                    for(int column = std::max(band.start, band.end); column < n_spectrum_floats; ++column)
+                        spectrum[column] *= normalisation;
+                }
+
+                if(planned)
+                    fftwf_execute_dft_c2r(tail ? tail_backward_plan : backward_plan,
+                                          reinterpret_cast<fftwf_complex*>(scratch[thread_id].spectra.data()), output);
+
+                for(int row = 0; row < n_rows; ++row) {
+                    const int timeseries_id = (batch_row + row) / params.n_channels;
+                    const int channel_id = (batch_row + row) % params.n_channels;
+                    if(!params.active_channels[channel_id]) { //Passed through unfiltered
+                        if(compact)
+                            data_container.put_current_output_sample(layer_id, timeseries_id, channel_id,
+                                    data_container.get_current_input_sample(layer_id, timeseries_id, channel_id));
+                        else
+                            data_container.get_input_timeseries(layer_id, timeseries_id, channel_id).copyTo(
+                                    data_container.get_output_timeseries(layer_id, timeseries_id, channel_id));
+                    } else if(!planned)
+                        data_container.repeat_output_sample(layer_id, timeseries_id, channel_id);
+                    else if(compact)
+                        data_container.put_current_output_sample(layer_id, timeseries_id, channel_id,
+                                output[row * params.n_buffered_frames + position]);
+                }
+            });
+
+            data_container.write_back_timeseries(layer_id, block_start, block_end - block_start);
+        }
+    }
+}
+
+/**
+* Offline ideal filtering of a whole buffered video: Each timeseries is transformed exactly once over all of its frames,
+* the filtered timeseries replaces the input history. Blocks of timeseries are prefetched and written back in turn, so
+* this also works with memory-mapped temporal buffers larger than the RAM.
+*/
+void temporal_filter::ideal_filter_offline(parameter_store& params, DataContainer& data_container, const int n_frames) {
+    if(n_frames <= 0)
+        return;
+    int n_layers = params.spatial_filter == spatial_filter_type::LAPLACIAN ? params.n_layers : 1;
+
+    cv::Range band(std::max(0, static_cast<int>(params.min_freq / static_cast<float>(params.fps) * n_frames)),
+                   std::min(n_frames / 2 + 1, static_cast<int>(params.max_freq / static_cast<float>(params.fps) * n_frames)));
+
+    //A single pair of measured plans, worth waiting for as every timeseries is transformed over the whole video
+    const fftwf_plan forward_plan = FFTWPlanner::instance().get_measured({true, n_frames, 1, 1, 0});
+    const fftwf_plan backward_plan = FFTWPlanner::instance().get_measured({false, n_frames, 1, 1, 0});
+
+    //Tasks of rows_per_task timeseries rows (timeseries_id*n_channels+channel_id) each
+    const int rows_per_task = 16;
+    TaskPool& task_pool = TaskPool::instance();
+    std::vector<std::vector<float>> timeseries_scratch(task_pool.get_n_threads(), std::vector<float>(params.n_buffered_frames));
+    std::vector<std::vector<float>> spectrum_scratch(task_pool.get_n_threads(), std::vector<float>(2 * (n_frames / 2 + 1)));
+
+    for (int layer_id = 0; layer_id < n_layers; ++layer_id) {
+        float layer_lambda = sqrtf(powf(fit_to_layer(params.roi_rect.size(), layer_id).width, 2.f)
+                                   + powf(fit_to_layer(params.roi_rect.size(), layer_id).height, 2.f));
+        float calculated_alpha = layer_lambda / params.lambda_c * (1 + params.alpha);
+        float gain = calculated_alpha < params.alpha ? calculated_alpha : params.alpha;
+        int n_timeseries = params.spatial_filter == spatial_filter_type::LAPLACIAN ?
+                           fit_to_layer(params.roi_rect.size(), layer_id).area() :
+                           fit_to_layer(params.roi_rect.size(), params.n_layers - 1).area();
+
+        const int block_size = data_container.get_timeseries_block_size(layer_id);
+        data_container.prefetch_timeseries(layer_id, 0, block_size);
+        for (int block_start = 0; block_start < n_timeseries; block_start += block_size) {
+            const int block_end = std::min(n_timeseries, block_start + block_size);
+            data_container.prefetch_timeseries(layer_id, block_end, block_size);
+
+            const int first_row = block_start * params.n_channels;
+            const int end_row = block_end * params.n_channels;
+            task_pool.parallel_for((end_row - first_row + rows_per_task - 1) / rows_per_task,
+                                   [&](const int task_id, const int thread_id) {
+                float* timeseries = timeseries_scratch[thread_id].data();
+                float* spectrum = spectrum_scratch[thread_id].data();
+                const int task_end_row = std::min(end_row, first_row + (task_id + 1) * rows_per_task);
+                for (int row = first_row + task_id * rows_per_task; row < task_end_row; ++row) {
+                    const int timeseries_id = row / params.n_channels;
+                    const int channel_id = row % params.n_channels;
+                    if (!params.active_channels[channel_id]) //The history already holds the unfiltered input
+                        continue;
+
+                    data_container.widen_input_timeseries(layer_id, timeseries_id, channel_id, timeseries);
+                    fftwf_execute_dft_r2c(forward_plan, timeseries,
+                                          reinterpret_cast<fftwf_complex*>(spectrum));
+                    for(int bin_id = band.start; bin_id < band.end; ++bin_id) {
+                        spectrum[2 * bin_id] *= gain;
+                        spectrum[2 * bin_id + 1] *= gain;
+                    }
+                    fftwf_execute_dft_c2r(backward_plan, reinterpret_cast<fftwf_complex*>(spectrum),
+                                          timeseries);
+                    for(int frame_id = 0; frame_id < n_frames; ++frame_id)
+                        timeseries[frame_id] /= static_cast<float>(n_frames);
+                    data_container.replace_input_timeseries(layer_id, timeseries_id, channel_id, timeseries);
+                }
+            });
+
+            data_container.write_back_timeseries(layer_id, block_start, block_end - block_start);
         }
     }
 }
 
+/**
+* Fused IIR kernel for a run of n floats: Updates both lowpass states and writes the amplified sample in a single
+* read-modify-write pass; output may alias input.
+*/
+inline void iir_filter_run(const float* input, float* lowpass_hi, float* lowpass_lo, float* output, const int n,
+                           const float cutoff_hi, const float cutoff_lo, const float gain) noexcept {
+    int i = 0;
+#if defined(__AVX__)
+    const __m256 c_hi = _mm256_set1_ps(cutoff_hi), c_lo = _mm256_set1_ps(cutoff_lo), g = _mm256_set1_ps(gain);
+    const __m256 keep_hi = _mm256_set1_ps(1.f - cutoff_hi), keep_lo = _mm256_set1_ps(1.f - cutoff_lo);
+    for(; i + 8 <= n; i += 8) {
+        const __m256 x = _mm256_loadu_ps(input + i);
+        const __m256 hi = _mm256_add_ps(_mm256_mul_ps(keep_hi, _mm256_loadu_ps(lowpass_hi + i)), _mm256_mul_ps(c_hi, x));
+        const __m256 lo = _mm256_add_ps(_mm256_mul_ps(keep_lo, _mm256_loadu_ps(lowpass_lo + i)), _mm256_mul_ps(c_lo, x));
+        _mm256_storeu_ps(lowpass_hi + i, hi);
+        _mm256_storeu_ps(lowpass_lo + i, lo);
+        _mm256_storeu_ps(output + i, _mm256_add_ps(x, _mm256_mul_ps(g, _mm256_sub_ps(hi, lo))));
+    }
+#elif defined(__SSE2__)
+    const __m128 c_hi = _mm_set1_ps(cutoff_hi), c_lo = _mm_set1_ps(cutoff_lo), g = _mm_set1_ps(gain);
+    const __m128 keep_hi = _mm_set1_ps(1.f - cutoff_hi), keep_lo = _mm_set1_ps(1.f - cutoff_lo);
+    for(; i + 4 <= n; i += 4) {
+        const __m128 x = _mm_loadu_ps(input + i);
+        const __m128 hi = _mm_add_ps(_mm_mul_ps(keep_hi, _mm_loadu_ps(lowpass_hi + i)), _mm_mul_ps(c_hi, x));
+        const __m128 lo = _mm_add_ps(_mm_mul_ps(keep_lo, _mm_loadu_ps(lowpass_lo + i)), _mm_mul_ps(c_lo, x));
+        _mm_storeu_ps(lowpass_hi + i, hi);
+        _mm_storeu_ps(lowpass_lo + i, lo);
+        _mm_storeu_ps(output + i, _mm_add_ps(x, _mm_mul_ps(g, _mm_sub_ps(hi, lo))));
+    }
+#endif
+    for(; i < n; ++i) {
+        const float x = input[i];
+        lowpass_hi[i] = (1.f - cutoff_hi) * lowpass_hi[i] + cutoff_hi * x;
+        lowpass_lo[i] = (1.f - cutoff_lo) * lowpass_lo[i] + cutoff_lo * x;
+        output[i] = x + gain * (lowpass_hi[i] - lowpass_lo[i]);
+    }
+}
+
+//A band of rows of one layer, the unit of work of the IIR filter
+struct iir_tile {
+    int layer_id;
+    int first_row;
+    int end_row;
+};
+
 void temporal_filter::iir_filter(parameter_store& params, DataContainer& data_container) {
-#pragma omp parallel for shared(params, data_container)
-    for(int layer_id = (params.spatial_filter == spatial_filter_type::GAUSSIAN ? params.n_layers-1 : 0); layer_id < params.n_layers; ++layer_id) {
-        cv::Mat current_layer_data = data_container.get_layer(layer_id);
+    if (params.cutoffLo == 0.0) params.cutoffLo = 0.001;
+
+    //Split all layers into tiles of about iir_tile_floats values, so that all threads get work even for few layers
+    const int iir_tile_floats = 16384;
+    const int first_layer_id = params.spatial_filter == spatial_filter_type::GAUSSIAN ? params.n_layers-1 : 0;
+    std::vector<cv::Mat> layers(params.n_layers), lowpassHi(params.n_layers), lowpassLo(params.n_layers);
+    std::vector<float> gains(params.n_layers);
+    std::vector<iir_tile> tiles;
+    for(int layer_id = first_layer_id; layer_id < params.n_layers; ++layer_id) {
+        layers[layer_id] = data_container.get_layer(layer_id);
+        lowpassHi[layer_id] = data_container.get_lowpassHi(layer_id);
+        lowpassLo[layer_id] = data_container.get_lowpassLo(layer_id);
 
         float layer_lambda = sqrtf(powf(fit_to_layer(params.roi_rect.size(), layer_id).width, 2.f)
                                    + powf(fit_to_layer(params.roi_rect.size(), layer_id).height, 2.f));
         float calculated_alpha = layer_lambda / params.lambda_c * (1 + params.alpha);
+        gains[layer_id] = calculated_alpha < params.alpha ? calculated_alpha : params.alpha;
+
+        const int row_floats = std::max(layers[layer_id].cols * layers[layer_id].channels(), 1);
+        const int rows_per_tile = std::max(iir_tile_floats / row_floats, 1);
+        for(int row = 0; row < layers[layer_id].rows; row += rows_per_tile)
+            tiles.push_back({layer_id, row, std::min(layers[layer_id].rows, row + rows_per_tile)});
+    }
+
+    TaskPool::instance().parallel_for(static_cast<int>(tiles.size()), [&](const int tile_id, const int) {
+        const iir_tile& tile = tiles[tile_id];
+        for(int row = tile.first_row; row < tile.end_row; ++row) { //The layer is amplified in place
+            float* layer_row = layers[tile.layer_id].ptr<float>(row);
+            iir_filter_run(layer_row, lowpassHi[tile.layer_id].ptr<float>(row), lowpassLo[tile.layer_id].ptr<float>(row),
+                           layer_row, layers[tile.layer_id].cols * layers[tile.layer_id].channels(), params.cutoffHi,
+                           params.cutoffLo, gains[tile.layer_id]);
+        }
+    });
+
+    for(int layer_id = first_layer_id; layer_id < params.n_layers; ++layer_id)
+        data_container.put_layer(layer_id, layers[layer_id]);
+}
+
+//Minimal arithmetic over either a single float or the widest available SIMD vector, so that the kernels of the Riesz
+//filter are written once and the scalar instantiation handles the remainder of each row
+struct scalar_lanes {
+    typedef float type;
+    static const int width = 1;
+    static float set(const float value) noexcept { return value; }
+    static float load(const float* source) noexcept { return *source; }
+    static void store(float* destination, const float value) noexcept { *destination = value; }
+    static float add(const float a, const float b) noexcept { return a + b; }
+    static float sub(const float a, const float b) noexcept { return a - b; }
+    static float mul(const float a, const float b) noexcept { return a * b; }
+    static float div(const float a, const float b) noexcept { return a / b; }
+    static float sqrt(const float a) noexcept { return sqrtf(a); }
+    static float min(const float a, const float b) noexcept { return a < b ? a : b; }
+    static float max(const float a, const float b) noexcept { return a < b ? b : a; }
+    static float abs(const float a) noexcept { return fabsf(a); }
+    static float truncate(const float a) noexcept { return static_cast<float>(static_cast<int>(a)); }
+    static float select_less(const float a, const float b, const float if_less, const float otherwise) noexcept {
+        return a < b ? if_less : otherwise;
+    }
+};
+
+#if defined(__AVX__)
+typedef __m256 simd_float;
+
+struct vector_lanes {
+    typedef simd_float type;
+    static const int width = 8;
+    static simd_float set(const float value) noexcept { return _mm256_set1_ps(value); }
+    static simd_float load(const float* source) noexcept { return _mm256_loadu_ps(source); }
+    static void store(float* destination, const simd_float value) noexcept { _mm256_storeu_ps(destination, value); }
+    static simd_float add(const simd_float a, const simd_float b) noexcept { return _mm256_add_ps(a, b); }
+    static simd_float sub(const simd_float a, const simd_float b) noexcept { return _mm256_sub_ps(a, b); }
+    static simd_float mul(const simd_float a, const simd_float b) noexcept { return _mm256_mul_ps(a, b); }
+    static simd_float div(const simd_float a, const simd_float b) noexcept { return _mm256_div_ps(a, b); }
+    static simd_float sqrt(const simd_float a) noexcept { return _mm256_sqrt_ps(a); }
+    static simd_float min(const simd_float a, const simd_float b) noexcept { return _mm256_min_ps(a, b); }
+    static simd_float max(const simd_float a, const simd_float b) noexcept { return _mm256_max_ps(a, b); }
+    static simd_float abs(const simd_float a) noexcept { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+    static simd_float truncate(const simd_float a) noexcept { return _mm256_round_ps(a, _MM_FROUND_TO_ZERO); }
+    static simd_float select_less(const simd_float a, const simd_float b, const simd_float if_less,
+                                  const simd_float otherwise) noexcept {
+        return _mm256_blendv_ps(otherwise, if_less, _mm256_cmp_ps(a, b, _CMP_LT_OQ));
+    }
+};
+#elif defined(__SSE2__)
+typedef __m128 simd_float;
+
+struct vector_lanes {
+    typedef simd_float type;
+    static const int width = 4;
+    static simd_float set(const float value) noexcept { return _mm_set1_ps(value); }
+    static simd_float load(const float* source) noexcept { return _mm_loadu_ps(source); }
+    static void store(float* destination, const simd_float value) noexcept { _mm_storeu_ps(destination, value); }
+    static simd_float add(const simd_float a, const simd_float b) noexcept { return _mm_add_ps(a, b); }
+    static simd_float sub(const simd_float a, const simd_float b) noexcept { return _mm_sub_ps(a, b); }
+    static simd_float mul(const simd_float a, const simd_float b) noexcept { return _mm_mul_ps(a, b); }
+    static simd_float div(const simd_float a, const simd_float b) noexcept { return _mm_div_ps(a, b); }
+    static simd_float sqrt(const simd_float a) noexcept { return _mm_sqrt_ps(a); }
+    static simd_float min(const simd_float a, const simd_float b) noexcept { return _mm_min_ps(a, b); }
+    static simd_float max(const simd_float a, const simd_float b) noexcept { return _mm_max_ps(a, b); }
+    static simd_float abs(const simd_float a) noexcept { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+    static simd_float truncate(const simd_float a) noexcept { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a)); }
+    static simd_float select_less(const simd_float a, const simd_float b, const simd_float if_less,
+                                  const simd_float otherwise) noexcept {
+        const simd_float mask = _mm_cmplt_ps(a, b);
+        return _mm_or_ps(_mm_and_ps(mask, if_less), _mm_andnot_ps(mask, otherwise));
+    }
+};
+#endif
+
+//atan2(y, x) for y >= 0, within 2e-6 rad
+template<typename s>
+inline typename s::type fast_atan2(const typename s::type y, const typename s::type x) noexcept {
+    typedef typename s::type T;
+    const T abs_x = s::abs(x);
+    const T z = s::div(s::min(abs_x, y), s::max(s::max(abs_x, y), s::set(1e-30f)));
+    const T z2 = s::mul(z, z);
+    T polynomial = s::add(s::set(0.05265332f), s::mul(z2, s::set(-0.01172120f)));
+    polynomial = s::add(s::set(-0.11643287f), s::mul(z2, polynomial));
+    polynomial = s::add(s::set(0.19354346f), s::mul(z2, polynomial));
+    polynomial = s::add(s::set(-0.33262347f), s::mul(z2, polynomial));
+    polynomial = s::add(s::set(0.99997726f), s::mul(z2, polynomial));
+    T angle = s::mul(z, polynomial);
+    angle = s::select_less(abs_x, y, s::sub(s::set(1.57079633f), angle), angle);
+    return s::select_less(x, s::set(0.f), s::sub(s::set(3.14159265f), angle), angle);
+}
+
+//Sine and cosine for angle >= 0, within 4e-6
+template<typename s>
+inline void fast_sincos(const typename s::type angle, typename s::type& sine, typename s::type& cosine) noexcept {
+    typedef typename s::type T;
+    const T reduced = s::sub(angle, s::mul(s::set(6.28318531f),
+                                           s::truncate(s::add(s::mul(angle, s::set(.159154943f)), s::set(.5f)))));
+    //Fold [-pi, pi] into [-pi/2, pi/2], which flips the sign of the cosine
+    const T folded = s::select_less(s::set(1.57079633f), reduced, s::sub(s::set(3.14159265f), reduced),
+                                    s::select_less(reduced, s::set(-1.57079633f), s::sub(s::set(-3.14159265f), reduced),
+                                                   reduced));
+    const T sign = s::select_less(s::set(1.57079633f), s::abs(reduced), s::set(-1.f), s::set(1.f));
+    const T f2 = s::mul(folded, folded);
+    T sine_polynomial = s::add(s::set(-1.f/5040), s::mul(f2, s::set(1.f/362880)));
+    sine_polynomial = s::add(s::set(1.f/120), s::mul(f2, sine_polynomial));
+    sine_polynomial = s::add(s::set(-1.f/6), s::mul(f2, sine_polynomial));
+    sine_polynomial = s::add(s::set(1.f), s::mul(f2, sine_polynomial));
+    T cosine_polynomial = s::add(s::set(1.f/40320), s::mul(f2, s::set(-1.f/3628800)));
+    cosine_polynomial = s::add(s::set(-1.f/720), s::mul(f2, cosine_polynomial));
+    cosine_polynomial = s::add(s::set(1.f/24), s::mul(f2, cosine_polynomial));
+    cosine_polynomial = s::add(s::set(-.5f), s::mul(f2, cosine_polynomial));
+    cosine_polynomial = s::add(s::set(1.f), s::mul(f2, cosine_polynomial));
+    sine = s::mul(folded, sine_polynomial);
+    cosine = s::mul(sign, cosine_polynomial);
+}
+
+//One row of a layer and of its Riesz filter state
+struct riesz_row {
+    float* real;
+    const float* x;
+    const float* y;
+    float* previous_real;
+    const float* previous_x;
+    const float* previous_y;
+    float* phase_cos;
+    float* phase_sin;
+    float* lowpass_hi_cos;
+    float* lowpass_hi_sin;
+    float* lowpass_lo_cos;
+    float* lowpass_lo_sin;
+    float* weighted_cos;
+    float* weighted_sin;
+    float* amplitude;
+};
+
+/**
+* Phase tracking of the floats [i, i+width) of a row: Accumulates the phase difference to the previous frame, taken from
+* the product of the current and the conjugated previous coefficient, band-passes the accumulated phase with the IIR
+* lowpass pair and writes it weighted by the local amplitude, along with that amplitude.
+*/
+template<typename s>
+inline void riesz_track_phase(const riesz_row& row, const int i, const float cutoff_hi, const float cutoff_lo) noexcept {
+    typedef typename s::type T;
+    const T real = s::load(row.real + i), x = s::load(row.x + i), y = s::load(row.y + i);
+    const T previous_real = s::load(row.previous_real + i);
+    const T previous_x = s::load(row.previous_x + i), previous_y = s::load(row.previous_y + i);
+    const T product_real = s::add(s::add(s::mul(real, previous_real), s::mul(x, previous_x)), s::mul(y, previous_y));
+    const T product_x = s::sub(s::mul(previous_real, x), s::mul(real, previous_x));
+    const T product_y = s::sub(s::mul(previous_real, y), s::mul(real, previous_y));
+    const T orientation_norm = s::sqrt(s::add(s::mul(product_x, product_x), s::mul(product_y, product_y)));
+
+    //Where the orientation is undefined, product_x and product_y are zero and so is the phase difference
+    const T scale = s::div(fast_atan2<s>(orientation_norm, product_real), s::max(orientation_norm, s::set(1e-30f)));
+    const T phase_cos = s::add(s::load(row.phase_cos + i), s::mul(scale, product_x));
+    const T phase_sin = s::add(s::load(row.phase_sin + i), s::mul(scale, product_y));
+    s::store(row.phase_cos + i, phase_cos);
+    s::store(row.phase_sin + i, phase_sin);
+    s::store(row.previous_real + i, real);
+
+    const T keep_hi = s::set(1.f - cutoff_hi), c_hi = s::set(cutoff_hi);
+    const T keep_lo = s::set(1.f - cutoff_lo), c_lo = s::set(cutoff_lo);
+    const T hi_cos = s::add(s::mul(keep_hi, s::load(row.lowpass_hi_cos + i)), s::mul(c_hi, phase_cos));
+    const T hi_sin = s::add(s::mul(keep_hi, s::load(row.lowpass_hi_sin + i)), s::mul(c_hi, phase_sin));
+    const T lo_cos = s::add(s::mul(keep_lo, s::load(row.lowpass_lo_cos + i)), s::mul(c_lo, phase_cos));
+    const T lo_sin = s::add(s::mul(keep_lo, s::load(row.lowpass_lo_sin + i)), s::mul(c_lo, phase_sin));
+    s::store(row.lowpass_hi_cos + i, hi_cos);
+    s::store(row.lowpass_hi_sin + i, hi_sin);
+    s::store(row.lowpass_lo_cos + i, lo_cos);
+    s::store(row.lowpass_lo_sin + i, lo_sin);
+
+    const T amplitude = s::sqrt(s::sqrt(s::add(s::mul(product_real, product_real),
+                                               s::mul(orientation_norm, orientation_norm))));
+    s::store(row.weighted_cos + i, s::mul(s::sub(hi_cos, lo_cos), amplitude));
+    s::store(row.weighted_sin + i, s::mul(s::sub(hi_sin, lo_sin), amplitude));
+    s::store(row.amplitude + i, amplitude);
+}
+
+/**
+* Phase shift of the floats [i, i+width) of a row by alpha times the smoothed phase, i.e. the real part of the quaternion
+* exp(alpha * phase) times the coefficient; channel_mask is 1 for the floats of active channels and 0 otherwise.
+*/
+template<typename s>
+inline void riesz_shift_phase(const riesz_row& row, const float* channel_mask, const int i, const float alpha) noexcept {
+    typedef typename s::type T;
+    const T gain = s::div(s::set(alpha), s::add(s::load(row.amplitude + i), s::set(1e-6f)));
+    const T shift_cos = s::mul(s::load(row.weighted_cos + i), gain);
+    const T shift_sin = s::mul(s::load(row.weighted_sin + i), gain);
+    const T shift = s::sqrt(s::add(s::mul(shift_cos, shift_cos), s::mul(shift_sin, shift_sin)));
+    T sine, cosine;
+    fast_sincos<s>(shift, sine, cosine);
+
+    const T real = s::load(row.real + i);
+    const T rotated = s::add(s::mul(shift_cos, s::load(row.x + i)), s::mul(shift_sin, s::load(row.y + i)));
+    const T shifted = s::sub(s::mul(cosine, real), s::mul(s::div(sine, s::max(shift, s::set(1e-30f))), rotated));
+    s::store(row.real + i, s::add(real, s::mul(s::load(channel_mask + i), s::sub(shifted, real))));
+}
+
+/**
+* Phase-based magnification with Riesz pyramids (Wadhwa et al., Riesz Pyramids for Fast Phase-Based Video
+* Magnification): The quaternionic phase of each Laplacian coefficient is tracked from frame to frame, band-passed with
+* the IIR lowpass pair, smoothed weighted by the local amplitude and applied as an amplified phase shift. Only a few
+* matrices per layer are kept instead of a history of frames; the coarsest layer is left untouched.
+*/
+void temporal_filter::riesz_filter(parameter_store& params, DataContainer& data_container) {
+    if (params.cutoffLo == 0.0) params.cutoffLo = 0.001;
+
+    const double amplitude_sigma = 2.;
+    const int riesz_tile_floats = 16384;
+    BufferPool& buffer_pool = data_container.get_buffer_pool();
+    TaskPool& task_pool = TaskPool::instance();
+
+    for(int layer_id = 0; layer_id < params.n_layers-1; ++layer_id) {
+        cv::Mat layer = data_container.get_layer(layer_id);
+        riesz_layer_state& state = data_container.get_riesz_state(layer_id);
+        cv::Mat riesz_x, riesz_y;
+        spatial_filter::riesz_transform(layer, riesz_x, riesz_y, &buffer_pool);
 
-        if (params.cutoffLo == 0.0) params.cutoffLo = 0.001;
+        if(state.previous[0].size() != layer.size()) { //First frame: The phase does not change against itself
+            state.previous[0] = buffer_pool.matrix();
+            layer.copyTo(state.previous[0]);
+            state.previous[1] = riesz_x;
+            state.previous[2] = riesz_y;
+            for(int part = 0; part < 2; ++part) {
+                state.phase[part] = cv::Mat::zeros(layer.size(), layer.type());
+                state.lowpassLo[part] = cv::Mat::zeros(layer.size(), layer.type());
+                state.lowpassHi[part] = cv::Mat::zeros(layer.size(), layer.type());
+            }
+        }
 
-        cv::Mat lowpassHi = data_container.get_lowpassHi(layer_id);
-        cv::Mat lowpassLo = data_container.get_lowpassLo(layer_id);
+        cv::Mat weighted_cos = buffer_pool.matrix(), weighted_sin = buffer_pool.matrix();
+        cv::Mat amplitude = buffer_pool.matrix();
+        weighted_cos.create(layer.size(), layer.type());
+        weighted_sin.create(layer.size(), layer.type());
+        amplitude.create(layer.size(), layer.type());
 
-        lowpassHi = (1 - params.cutoffHi) * lowpassHi + params.cutoffHi * current_layer_data;
-        lowpassLo = (1 - params.cutoffLo) * lowpassLo + params.cutoffLo * current_layer_data;
+        //Inactive channels are tracked as well, but their coefficients are not shifted
+        const int row_floats = layer.cols * layer.channels();
+        std::vector<float> channel_mask(row_floats);
+        for(int i = 0; i < row_floats; ++i)
+            channel_mask[i] = params.active_channels[i % params.n_channels] ? 1.f : 0.f;
 
-        data_container.put_layer(layer_id, current_layer_data +
-                (calculated_alpha < params.alpha ? calculated_alpha : params.alpha) * (lowpassHi - lowpassLo));
+        auto get_row = [&](const int row) -> riesz_row {
+            return {layer.ptr<float>(row), riesz_x.ptr<float>(row), riesz_y.ptr<float>(row),
+                    state.previous[0].ptr<float>(row), state.previous[1].ptr<float>(row),
+                    state.previous[2].ptr<float>(row), state.phase[0].ptr<float>(row), state.phase[1].ptr<float>(row),
+                    state.lowpassHi[0].ptr<float>(row), state.lowpassHi[1].ptr<float>(row),
+                    state.lowpassLo[0].ptr<float>(row), state.lowpassLo[1].ptr<float>(row),
+                    weighted_cos.ptr<float>(row), weighted_sin.ptr<float>(row), amplitude.ptr<float>(row)};
+        };
+
+        //Tasks of about riesz_tile_floats values each
+        const int rows_per_task = std::max(riesz_tile_floats / std::max(row_floats, 1), 1);
+        const int n_tasks = (layer.rows + rows_per_task - 1) / rows_per_task;
+        task_pool.parallel_for(n_tasks, [&](const int task_id, const int) {
+            for(int row = task_id * rows_per_task; row < std::min(layer.rows, (task_id + 1) * rows_per_task); ++row) {
+                const riesz_row current_row = get_row(row);
+                int i = 0;
+#if defined(__AVX__) || defined(__SSE2__)
+                for(; i + vector_lanes::width <= row_floats; i += vector_lanes::width)
+                    riesz_track_phase<vector_lanes>(current_row, i, params.cutoffHi, params.cutoffLo);
+#endif
+                for(; i < row_floats; ++i)
+                    riesz_track_phase<scalar_lanes>(current_row, i, params.cutoffHi, params.cutoffLo);
+            }
+        });
+        state.previous[1] = riesz_x;
+        state.previous[2] = riesz_y;
+
+        //Amplitude weighted smoothing of the filtered phase, which suppresses it where it is dominated by noise
+        cv::GaussianBlur(weighted_cos, weighted_cos, cv::Size(0, 0), amplitude_sigma);
+        cv::GaussianBlur(weighted_sin, weighted_sin, cv::Size(0, 0), amplitude_sigma);
+        cv::GaussianBlur(amplitude, amplitude, cv::Size(0, 0), amplitude_sigma);
+
+        task_pool.parallel_for(n_tasks, [&](const int task_id, const int) {
+            for(int row = task_id * rows_per_task; row < std::min(layer.rows, (task_id + 1) * rows_per_task); ++row) {
+                const riesz_row current_row = get_row(row); //The layer is shifted in place
+                int i = 0;
+#if defined(__AVX__) || defined(__SSE2__)
+                for(; i + vector_lanes::width <= row_floats; i += vector_lanes::width)
+                    riesz_shift_phase<vector_lanes>(current_row, channel_mask.data(), i, params.alpha);
+#endif
+                for(; i < row_floats; ++i)
+                    riesz_shift_phase<scalar_lanes>(current_row, channel_mask.data(), i, params.alpha);
+            }
+        });
+        data_container.put_layer(layer_id, layer);
     }
 }
@@ -13,10 +13,15 @@ bool VideoSource::open(const std::string video_filename) {
     return (open_success && video_source.isOpened());
 }
 
-bool VideoSource::open(const int video_device) {
+//OpenCV cannot enumerate capture modes, so only the target frame rate of the request is passed on
+bool VideoSource::open(const int video_device, const int n_capture_buffers, const capture_request& request) {
     bool open_success = true;
     is_live_feed = true;
-    try { video_source.open(video_device); }
+    try {
+        video_source.open(video_device);
+        video_source.set(cv::CAP_PROP_BUFFERSIZE, n_capture_buffers); //Ignored by backends without a buffer ring
+        video_source.set(cv::CAP_PROP_FPS, request.target_fps);
+    }
     catch(...) { open_success = false; }
     first_playback = true;
     return (open_success && video_source.isOpened());
@@ -46,6 +51,20 @@ void VideoSource::operator>>(cv::Mat& out) noexcept {
         video_source.set(CV_CAP_PROP_POS_FRAMES, 0.0);
         video_source >> out;
     }
+    capture_time = std::chrono::steady_clock::now();
+}
+
+//OpenCV always converts to BGR
+void VideoSource::read_raw(cv::Mat& out) noexcept {
+    *this >> out;
+}
+
+pixel_format_type VideoSource::get_raw_pixel_format() const noexcept {
+    return pixel_format_type::BGR;
+}
+
+std::chrono::steady_clock::time_point VideoSource::get_capture_time() const noexcept {
+    return capture_time;
 }
 
 const cv::Size VideoSource::get_frame_size() {
@@ -10,17 +10,15 @@ bool VideoSource::open(const std::string video_filename) {
     return (open_success && video_source.isOpened());
 }
 
-bool VideoSource::open(const int video_device) {
+bool VideoSource::open(const int video_device, const int n_capture_buffers, const capture_request& request) {
     is_live_feed = true;
     first_playback = true;
-    return video_source_v4l2.open("/dev/video"+std::to_string(video_device));
+    return video_source_v4l2.open("/dev/video"+std::to_string(video_device), n_capture_buffers, request);
 }
 
 void VideoSource::release() {
-    if(is_live_feed) {
+    if(is_live_feed)
         video_source_v4l2.release();
-        video_source_v4l2 = V4L2Capture();
-    }
     else {
         video_source.release();
         video_source = cv::VideoCapture();
@@ -37,6 +35,7 @@ VideoSource::~VideoSource() {
 void VideoSource::operator>>(cv::Mat& out) noexcept {
     if(is_live_feed) {
         video_source_v4l2 >> out;
+        capture_time = video_source_v4l2.get_timestamp();
     } else {
         video_source >> out;
         if(out.rows == 0) { //Loop the video
@@ -44,9 +43,26 @@ void VideoSource::operator>>(cv::Mat& out) noexcept {
             video_source.set(CV_CAP_PROP_POS_FRAMES, 0.0);
             video_source >> out;
         }
+        capture_time = std::chrono::steady_clock::now();
     }
 }
 
+void VideoSource::read_raw(cv::Mat& out) noexcept {
+    if(is_live_feed) {
+        video_source_v4l2.read(out);
+        capture_time = video_source_v4l2.get_timestamp();
+    } else
+        *this >> out;
+}
+
+pixel_format_type VideoSource::get_raw_pixel_format() const noexcept {
+    return is_live_feed ? video_source_v4l2.get_pixel_format() : pixel_format_type::BGR;
+}
+
+std::chrono::steady_clock::time_point VideoSource::get_capture_time() const noexcept {
+    return capture_time;
+}
+
 int VideoSource::get_fps() const noexcept {
     if(is_live_feed)
         return video_source_v4l2.get_fps();